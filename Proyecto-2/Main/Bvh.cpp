@@ -3,412 +3,570 @@
 #include "Kernel.hpp"
 
 #define ITEM_COUNT 4
+#define RADIX_BITS 8
+#define RADIX_SIZE 256
+#define SAH_BINS 16
+#define SAH_MAX_LEAF 16
+#define SAH_MAX_DEPTH 48
+#define SAH_TRAVERSAL_COST 1.0f
+#define SAH_INTERSECTION_COST 1.5f
+#define SAH_TASK_ITEMS 4096 // Smaller subtrees are split on the thread that reached them
 
-CPU_Bvh::CPU_Bvh():
+GPU_Bvh::GPU_Bvh() :
 	p_min(vec3(MAX_VEC1)),
+	first(0),
 	p_max(vec3(MIN_VEC1)),
-	parent(nullptr),
-	item_count(0),
-	discard(true)
+	count(0)
 {}
 
-CPU_Bvh::CPU_Bvh(const vec3& pmin, const vec3& pmax) :
-	p_min(pmin),
-	p_max(pmax),
-	parent(nullptr),
-	item_count(0)
-{
-	if (p_min.x > p_max.x) {
-		auto temp = p_min.x;
-		p_min.x = p_max.x;
-		p_max.x = temp;
-	}
-	if (p_min.y > p_max.y) {
-		auto temp = p_min.y;
-		p_min.y = p_max.y;
-		p_max.y = temp;
-	}
-	if (p_min.z > p_max.z) {
-		auto temp = p_min.z;
-		p_min.z = p_max.z;
-		p_max.z = temp;
-	}
-	discard = true;
+bool GPU_Bvh::isLeaf() const {
+	return (count & BVH_LEAF) != 0;
 }
 
-GPU_Bvh::GPU_Bvh() :
-	p_min(vec3(MAX_VEC1)),
-	p_max(vec3(MIN_VEC1)),
-	pointers_a(ivec4(-1)),
-	pointers_b(ivec4(-1)),
-	start(0),
-	end(0)
+uint GPU_Bvh::size() const {
+	return count & ~BVH_LEAF;
+}
+
+Octree_Node::Octree_Node(const vec3& p_min, const vec3& p_max, const uint& start, const uint& end) :
+	p_min(p_min),
+	p_max(p_max),
+	start(start),
+	end(end),
+	first_child(0),
+	child_count(0)
 {}
 
-void CPU_Bvh::growToInclude(const CPU_Probe* probe, const vec1& radius) {
-	growToInclude(d_to_f(probe->transformed_position) - radius, d_to_f(probe->transformed_position) + radius);
-}
+Octree_Builder::Octree_Builder() :
+	max_depth(0)
+{}
 
-void CPU_Bvh::growToInclude(const vec3& min, const vec3& max) {
-	p_min.x = min.x < p_min.x ? min.x : p_min.x;
-	p_min.y = min.y < p_min.y ? min.y : p_min.y;
-	p_min.z = min.z < p_min.z ? min.z : p_min.z;
-	p_max.x = max.x > p_max.x ? max.x : p_max.x;
-	p_max.y = max.y > p_max.y ? max.y : p_max.y;
-	p_max.z = max.z > p_max.z ? max.z : p_max.z;
-}
+void Octree_Builder::build(const vector<vec3>& positions, const uint& max_depth) {
+	const uint count = len32(positions);
+	this->max_depth = max_depth;
+	arena.clear();
+	items.resize(count);
+	iota(items.begin(), items.end(), 0U);
+
+	vec3 p_min = vec3(MAX_VEC1);
+	vec3 p_max = vec3(-MAX_VEC1);
+	for (const vec3& position : positions) {
+		p_min = glm::min(p_min, position);
+		p_max = glm::max(p_max, position);
+	}
 
-vec3 CPU_Bvh::getSize() const {
-	return p_max - p_min;
+	arena.push_back(Octree_Node(p_min, p_max, 0, count));
+	if (count > 0) {
+		splitNode(0, positions, 0);
+	}
+	convertNodes();
 }
 
-vec3 CPU_Bvh::getCenter() const {
-	return (p_min + p_max) / 2.0f;
-}
+void Octree_Builder::splitNode(const uint& index, const vector<vec3>& positions, const uint& depth) {
+	const Octree_Node node = arena[index];
+	const vec3 mid = (node.p_min + node.p_max) / 2.0f;
+
+	// Nested partitions by z, y and x leave the range ordered by octant (x | y << 1 | z << 2)
+	const auto base = items.begin();
+	uint bounds[9];
+	bounds[0] = node.start;
+	bounds[8] = node.end;
+	bounds[4] = static_cast<uint>(partition(base + bounds[0], base + bounds[8], [&](const uint& item) { return positions[item].z < mid.z; }) - base);
+	for (uint half = 0; half < 8; half += 4) {
+		bounds[half + 2] = static_cast<uint>(partition(base + bounds[half], base + bounds[half + 4], [&](const uint& item) { return positions[item].y < mid.y; }) - base);
+		for (uint quarter = half; quarter < half + 4; quarter += 2) {
+			bounds[quarter + 1] = static_cast<uint>(partition(base + bounds[quarter], base + bounds[quarter + 2], [&](const uint& item) { return positions[item].x < mid.x; }) - base);
+		}
+	}
 
-bool CPU_Bvh::contains(const CPU_Probe* probe) {
-	const vec3 pos = probe->transformed_position;
-	return (pos.x >= p_min.x && pos.x <= p_max.x) &&
-		(pos.y >= p_min.y && pos.y <= p_max.y) &&
-		(pos.z >= p_min.z && pos.z <= p_max.z);
-}
+	// Empty octants are never allocated
+	const uint first_child = len32(arena);
+	uint child_count = 0;
+	for (uint octant = 0; octant < 8; octant++) {
+		if (bounds[octant] == bounds[octant + 1]) {
+			continue;
+		}
+		const vec3 child_min = vec3(octant & 1 ? mid.x : node.p_min.x, octant & 2 ? mid.y : node.p_min.y, octant & 4 ? mid.z : node.p_min.z);
+		const vec3 child_max = vec3(octant & 1 ? node.p_max.x : mid.x, octant & 2 ? node.p_max.y : mid.y, octant & 4 ? node.p_max.z : mid.z);
+		arena.push_back(Octree_Node(child_min, child_max, bounds[octant], bounds[octant + 1]));
+		child_count++;
+	}
+	arena[index].first_child = first_child;
+	arena[index].child_count = child_count;
 
-void CPU_Bvh::growToInclude(const CPU_Particle* particle, const vec1& radius) {
-	growToInclude(d_to_f(particle->transformed_position) - radius, d_to_f(particle->transformed_position) + radius);
+	for (uint i = first_child; i < first_child + child_count; i++) {
+		if (depth < max_depth and arena[i].end - arena[i].start > ITEM_COUNT) {
+			splitNode(i, positions, depth + 1);
+		}
+	}
 }
 
-bool CPU_Bvh::contains(const CPU_Particle* particle) {
-	const vec3 pos = particle->transformed_position;
-	return (pos.x >= p_min.x && pos.x <= p_max.x) &&
-		(pos.y >= p_min.y && pos.y <= p_max.y) &&
-		(pos.z >= p_min.z && pos.z <= p_max.z);
+void Octree_Builder::convertNodes() {
+	nodes.resize(arena.size());
+	for (uint i = 0; i < len32(arena); i++) {
+		const Octree_Node& node = arena[i];
+		GPU_Bvh bvh = GPU_Bvh();
+		bvh.p_min = node.p_min;
+		bvh.p_max = node.p_max;
+		if (node.child_count == 0) {
+			bvh.first = node.start;
+			bvh.count = (node.end - node.start) | BVH_LEAF;
+		}
+		else {
+			bvh.first = node.first_child;
+			bvh.count = node.child_count;
+		}
+		nodes[i] = bvh;
+	}
 }
 
-void CPU_Bvh::split() {
-	children.clear();
-
-	vec3 mid = getCenter();
+static uint f_expandBits10(uint value) {
+	value &= 0x000003FF;
+	value = (value | (value << 16)) & 0x030000FF;
+	value = (value | (value <<  8)) & 0x0300F00F;
+	value = (value | (value <<  4)) & 0x030C30C3;
+	value = (value | (value <<  2)) & 0x09249249;
+	return value;
+}
 
-	children.push_back(CPU_Bvh(vec3(p_min.x, p_min.y, p_min.z), vec3(mid.x, mid.y, mid.z)));
-	children.push_back(CPU_Bvh(vec3(mid.x, p_min.y, p_min.z), vec3(p_max.x, mid.y, mid.z)));
-	children.push_back(CPU_Bvh(vec3(p_min.x, mid.y, p_min.z), vec3(mid.x, p_max.y, mid.z)));
-	children.push_back(CPU_Bvh(vec3(mid.x, mid.y, p_min.z), vec3(p_max.x, p_max.y, mid.z)));
-	children.push_back(CPU_Bvh(vec3(p_min.x, p_min.y, mid.z), vec3(mid.x, mid.y, p_max.z)));
-	children.push_back(CPU_Bvh(vec3(mid.x, p_min.y, mid.z), vec3(p_max.x, mid.y, p_max.z)));
-	children.push_back(CPU_Bvh(vec3(p_min.x, mid.y, mid.z), vec3(mid.x, p_max.y, p_max.z)));
-	children.push_back(CPU_Bvh(vec3(mid.x, mid.y, mid.z), vec3(p_max.x, p_max.y, p_max.z)));
+static uint64 f_expandBits21(uint64 value) {
+	value &= 0x00000000001FFFFF;
+	value = (value | (value << 32)) & 0x001F00000000FFFF;
+	value = (value | (value << 16)) & 0x001F0000FF0000FF;
+	value = (value | (value <<  8)) & 0x100F00F00F00F00F;
+	value = (value | (value <<  4)) & 0x10C30C30C30C30C3;
+	value = (value | (value <<  2)) & 0x1249249249249249;
+	return value;
+}
 
-	for (CPU_Bvh& child : children) {
-		child.parent = this;
+static uint f_leadingZeros(uint64 value) {
+	if (value == 0) {
+		return 64;
 	}
+	uint count = 0;
+	if (value <= 0x00000000FFFFFFFF) { count += 32; value <<= 32; }
+	if (value <= 0x0000FFFFFFFFFFFF) { count += 16; value <<= 16; }
+	if (value <= 0x00FFFFFFFFFFFFFF) { count +=  8; value <<=  8; }
+	if (value <= 0x0FFFFFFFFFFFFFFF) { count +=  4; value <<=  4; }
+	if (value <= 0x3FFFFFFFFFFFFFFF) { count +=  2; value <<=  2; }
+	if (value <= 0x7FFFFFFFFFFFFFFF) { count +=  1; }
+	return count;
 }
 
+Lbvh_Builder::Lbvh_Builder(const vector<vec3>& positions) {
+	const uint count = len32(positions);
+	if (count == 0) {
+		nodes.push_back(GPU_Bvh());
+		nodes[0].count = BVH_LEAF;
+		return;
+	}
 
-Builder::Builder(const vector<CPU_Probe*>& probes, const vec1& probe_radius, const uint& max_depth) :
-	source(probes),
-	particle_radius(probe_radius * 1.25f)
-{
-	if (probe_radius > 0.0f) {
-		for (CPU_Probe* probe : source) {
-			root_node.growToInclude(probe, probe_radius);
-		}
-		root_node.discard = false;
-		depth_cutoff = max_depth;
-
-		splitBvh(&root_node, 0);
-
-		convertBvh(&root_node);
+	vec3 p_min = vec3(MAX_VEC1);
+	vec3 p_max = vec3(-MAX_VEC1);
+	for (const vec3& position : positions) {
+		p_min = glm::min(p_min, position);
+		p_max = glm::max(p_max, position);
 	}
-	else {
-		for (CPU_Probe* probe : source) {
-			root_node.growToInclude(probe, d_to_f(probe->smoothing_radius));
+	const vec3 extent = glm::max(p_max - p_min, vec3(1e-6f));
+
+	// 10 bits per axis fit a 1024^3 grid, large inputs switch to 21 bits per axis to keep codes mostly unique
+	key_bits = count > (1U << 20) ? 63 : 30;
+	codes.resize(count);
+	items.resize(count);
+
+	f_parallelFor(0, count, [&](const uint& i) {
+		const vec3 normalized = (positions[i] - p_min) / extent;
+		if (key_bits == 30) {
+			const uvec3 cell = uvec3(glm::clamp(normalized * 1024.0f, vec3(0.0f), vec3(1023.0f)));
+			codes[i] = (f_expandBits10(cell.x) << 2) | (f_expandBits10(cell.y) << 1) | f_expandBits10(cell.z);
 		}
-		root_node.discard = false;
-		depth_cutoff = max_depth;
-
-		splitBvh(&root_node, 0);
-		growBvhSPH(&root_node);
-
-		convertBvhSPH(&root_node);
+		else {
+			const uvec3 cell = uvec3(glm::clamp(normalized * 2097152.0f, vec3(0.0f), vec3(2097151.0f)));
+			codes[i] = (f_expandBits21(cell.x) << 2) | (f_expandBits21(cell.y) << 1) | f_expandBits21(cell.z);
+		}
+		items[i] = i;
+	});
+	sortCodes();
+
+	// Internal nodes [0, count - 1), leaves [count - 1, 2 * count - 1)
+	nodes.resize(2 * u_to_ul(count) - 1);
+	children.resize(count - 1);
+	parents.assign(nodes.size(), MAX_UINT32);
+	f_parallelFor(0, count - 1, [&](const uint& i) {
+		buildNode(i);
+	});
+
+	vector<atomic<uint>> visits(count);
+	for (atomic<uint>& visit : visits) {
+		visit.store(0);
 	}
+	f_parallelFor(0, count, [&](const uint& i) {
+		growBounds(i, positions[items[i]], visits);
+	});
+	compactNodes();
 }
 
-void Builder::splitBvh(CPU_Bvh* node, const uint& depth) {
-	node->split();
-
-	for (auto it = node->children.begin(); it != node->children.end(); ) {
-		CPU_Bvh& child = *it;
-
-#ifdef OPENMP
-		#pragma omp parallel for
-		int i = 0;
-		int i_size = ul_to_i(source.size());
-		for (i = 0; i < i_size; i++) {
-			if (child.contains(source[i])) {
-				#pragma omp critical
-				{
-					child.item_count++;
-					if (child.item_count > ITEM_COUNT) {
-						break;
-					}
-				}
+void Lbvh_Builder::sortCodes() {
+	// Parallel LSD radix sort of (code, item) pairs, one histogram per chunk keeps the scatter stable
+	const uint count = len32(codes);
+	const uint chunks = min(JOBS.size(), max(count / 4096, 1U));
+	const uint chunk_size = (count + chunks - 1) / chunks;
+	const uint passes = (key_bits + RADIX_BITS - 1) / RADIX_BITS;
+
+	vector<uint64> sorted_codes(count);
+	vector<uint>   sorted_items(count);
+	vector<uint>   histograms(u_to_ul(chunks) * RADIX_SIZE);
+
+	for (uint pass = 0; pass < passes; pass++) {
+		const uint shift = pass * RADIX_BITS;
+		fill(histograms.begin(), histograms.end(), 0);
+
+		f_parallelFor(0, chunks, [&](const uint& c) {
+			uint* histogram = &histograms[u_to_ul(c) * RADIX_SIZE];
+			const uint end = min(count, (c + 1) * chunk_size);
+			for (uint i = c * chunk_size; i < end; i++) {
+				histogram[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
 			}
-		}
-#else
-		for (const CPU_Probe* probe : source) {
-			if (child.contains(probe)) {
-				child.discard = false;
-				child.item_count++;
-				if (child.item_count > ITEM_COUNT) {
-					break;
-				}
+		});
+
+		uint offset = 0;
+		for (uint digit = 0; digit < RADIX_SIZE; digit++) {
+			for (uint chunk = 0; chunk < chunks; chunk++) {
+				const uint digit_count = histograms[u_to_ul(chunk) * RADIX_SIZE + digit];
+				histograms[u_to_ul(chunk) * RADIX_SIZE + digit] = offset;
+				offset += digit_count;
 			}
 		}
-#endif
-		if (child.discard == false or child.item_count > 0) {
-			if (depth < depth_cutoff and child.item_count > ITEM_COUNT) {
-				splitBvh(&child, depth + 1);
-			}
-			else {
-#ifdef OPENMP
-				#pragma omp parallel for
-				int i = 0;
-				int i_size = ul_to_i(particles.size());
-				for (i = 0; i < i_size; i++) {
-					if (child.contains(particles[i])) {
-						#pragma omp critical
-						{
-							child.particles.push_back(particles[i]);
-						}
-					}
-				}
-#else
-				for (CPU_Probe* probe : source) {
-					if (child.contains(probe)) {
-						child.probes.push_back(probe);
-					}
-				}
-#endif
+
+		f_parallelFor(0, chunks, [&](const uint& c) {
+			uint* histogram = &histograms[u_to_ul(c) * RADIX_SIZE];
+			const uint end = min(count, (c + 1) * chunk_size);
+			for (uint i = c * chunk_size; i < end; i++) {
+				const uint target = histogram[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+				sorted_codes[target] = codes[i];
+				sorted_items[target] = items[i];
 			}
-			++it;
-		}
-		else {
-			it = node->children.erase(it);
-		}
+		});
+		codes.swap(sorted_codes);
+		items.swap(sorted_items);
 	}
 }
 
-uint Builder::convertBvh(CPU_Bvh* node) {
-	auto bvh = GPU_Bvh();
-	bvh.p_min = node->p_min - particle_radius;
-	bvh.p_max = node->p_max + particle_radius;
+int Lbvh_Builder::prefixLength(const int& a, const int& b) const {
+	if (b < 0 or b >= u_to_i(len32(codes))) {
+		return -1;
+	}
+	const uint64 code_a = codes[a];
+	const uint64 code_b = codes[b];
+	if (code_a == code_b) { // Duplicate codes are told apart by their sorted index
+		return 32 + f_leadingZeros(u_to_ul(i_to_u(a) ^ i_to_u(b)));
+	}
+	return f_leadingZeros(code_a ^ code_b);
+}
 
-	uint index = ul_to_u(nodes.size());
-	nodes.push_back(bvh);
+void Lbvh_Builder::buildNode(const uint& index) {
+	const int i = u_to_i(index);
+	const int leaf_offset = u_to_i(len32(codes)) - 1;
 
-	if (node->probes.empty()) {
-		for (uint i = 0; i < node->children.size(); i++) {
-			CPU_Bvh& child = node->children[i];
-			if (i < 4) {
-				bvh.pointers_a[i] = convertBvh(&child);
-			}
-			else {
-				bvh.pointers_b[i - 4] = convertBvh(&child);
-			}
-		}
+	// Direction of the range covered by this node, and its other end by exponential then binary search
+	const int direction = prefixLength(i, i + 1) - prefixLength(i, i - 1) > 0 ? 1 : -1;
+	const int min_prefix = prefixLength(i, i - direction);
+
+	int max_length = 2;
+	while (prefixLength(i, i + max_length * direction) > min_prefix) {
+		max_length *= 2;
 	}
-	else {
-		bvh.start =  ul_to_u(probes.size());
-		bvh.end =  ul_to_u(probes.size() + node->probes.size());
-		for (const auto& probe : node->probes) {
-			probes.push_back(probe);
+	int length = 0;
+	for (int step = max_length / 2; step > 0; step /= 2) {
+		if (prefixLength(i, i + (length + step) * direction) > min_prefix) {
+			length += step;
 		}
 	}
+	const int j = i + length * direction;
+
+	// Split position, where the common prefix of the range grows
+	const int node_prefix = prefixLength(i, j);
+	int split = 0;
+	int step = length;
+	do {
+		step = (step + 1) / 2;
+		if (prefixLength(i, i + (split + step) * direction) > node_prefix) {
+			split += step;
+		}
+	} while (step > 1);
+	const int gamma = i + split * direction + min(direction, 0);
 
-	nodes[index] = bvh;
-	if (node == &root_node) {
-		gpu_root_node = bvh;
-	}
-	return index;
+	const int left  = min(i, j) == gamma     ? leaf_offset + gamma     : gamma;
+	const int right = max(i, j) == gamma + 1 ? leaf_offset + gamma + 1 : gamma + 1;
+
+	children[index] = uvec2(i_to_u(left), i_to_u(right));
+	parents[i_to_u(left)] = index;
+	parents[i_to_u(right)] = index;
 }
 
-void Builder::growBvhSPH(CPU_Bvh* node) {
-	if (!node->probes.empty()) {
-		dvec1 radius = 0.0f;
-		for (CPU_Probe* probe : node->probes) {
-			radius = max(radius, probe->smoothing_radius);
+void Lbvh_Builder::compactNodes() {
+	// Breadth first from the root, both children of a node are written next to each other
+	const uint count = len32(codes);
+	vector<GPU_Bvh> compact(nodes.size());
+	vector<uint> source = { 0 };
+	source.reserve(nodes.size());
+	compact[0] = nodes[0];
+	for (uint i = 0; i < len32(source); i++) {
+		if (source[i] >= count - 1) {
+			continue;
 		}
-		node->p_min -= d_to_f(radius);
-		node->p_max += d_to_f(radius);
+		const uint first = len32(source);
+		source.push_back(children[source[i]].x);
+		source.push_back(children[source[i]].y);
+		compact[first] = nodes[children[source[i]].x];
+		compact[first + 1] = nodes[children[source[i]].y];
+		compact[i].first = first;
+		compact[i].count = 2;
+	}
+	nodes.swap(compact);
+}
 
-		CPU_Bvh* parent = node->parent;
-		while (parent) {
-			parent->growToInclude(node->p_min, node->p_max);
-			parent = parent->parent;
+void Lbvh_Builder::growBounds(const uint& leaf, const vec3& position, vector<atomic<uint>>& visits) {
+	uint node_index = len32(codes) - 1 + leaf;
+	GPU_Bvh& node = nodes[node_index];
+	node.p_min = position;
+	node.p_max = position;
+	node.first = leaf;
+	node.count = 1 | BVH_LEAF;
+
+	// The second child to arrive merges both bounds, so every internal node is written exactly once
+	uint parent = parents[node_index];
+	while (parent != MAX_UINT32) {
+		if (visits[parent].fetch_add(1, memory_order_acq_rel) == 0) {
+			return;
 		}
-	}
-	for (CPU_Bvh& child : node->children) {
-		growBvhSPH(&child);
+		GPU_Bvh& parent_node = nodes[parent];
+		const GPU_Bvh& left  = nodes[children[parent].x];
+		const GPU_Bvh& right = nodes[children[parent].y];
+		parent_node.p_min = glm::min(left.p_min, right.p_min);
+		parent_node.p_max = glm::max(left.p_max, right.p_max);
+		node_index = parent;
+		parent = parents[node_index];
 	}
 }
 
-uint Builder::convertBvhSPH(CPU_Bvh* node) {
-	auto bvh = GPU_Bvh();
+Sah_Bin::Sah_Bin() :
+	p_min(vec3(MAX_VEC1)),
+	p_max(vec3(-MAX_VEC1)),
+	count(0)
+{}
+
+Sah_Builder::Sah_Builder(const vector<vec3>& positions, const vec1& cost_radius) :
+	positions(positions),
+	cost_radius(cost_radius),
+	node_count(1U)
+{
+	const uint count = len32(positions);
+	items.resize(count);
+	iota(items.begin(), items.end(), 0U);
+
+	// Every leaf holds at least one item, so a binary tree never needs more than 2 * count - 1 nodes
+	nodes.resize(count > 0 ? 2 * u_to_ul(count) - 1 : 1);
+	if (count > 0) {
+		splitNode(0, 0, count, 0);
+	}
+	nodes.resize(node_count.load());
+}
 
-	bvh.p_min = node->p_min;
-	bvh.p_max = node->p_max;
+vec1 Sah_Builder::surfaceArea(const vec3& p_min, const vec3& p_max) const {
+	const vec3 size = glm::max(p_max - p_min, vec3(0.0f)) + 2.0f * cost_radius;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
 
-	uint index = ul_to_u(nodes.size());
-	nodes.push_back(bvh);
+void Sah_Builder::splitNode(const uint& index, const uint& start, const uint& end, const uint& depth) {
+	vec3 p_min = vec3(MAX_VEC1);
+	vec3 p_max = vec3(-MAX_VEC1);
+	for (uint i = start; i < end; i++) {
+		p_min = glm::min(p_min, positions[items[i]]);
+		p_max = glm::max(p_max, positions[items[i]]);
+	}
+	const vec3& c_min = p_min;
+	const vec3& c_max = p_max;
+	nodes[index].p_min = p_min;
+	nodes[index].p_max = p_max;
+
+	// Cost of a leaf against the best binned split, C = C_trav + (A_l * N_l + A_r * N_r) / A * C_isect
+	const uint count = end - start;
+	const vec1 leaf_cost = SAH_INTERSECTION_COST * count;
+	const vec1 inverse_area = 1.0f / max(surfaceArea(p_min, p_max), 1e-12f);
+	vec1 best_cost = MAX_VEC1;
+	int  best_axis = -1;
+	uint best_split = 0;
+
+	if (count > 1 and depth < SAH_MAX_DEPTH) {
+		for (int axis = 0; axis < 3; axis++) {
+			const vec1 extent = c_max[axis] - c_min[axis];
+			if (extent <= 0.0f) {
+				continue;
+			}
+			const vec1 scale = SAH_BINS / extent;
+			Sah_Bin bins[SAH_BINS];
+			for (uint i = start; i < end; i++) {
+				const vec3& position = positions[items[i]];
+				Sah_Bin& bin = bins[min(SAH_BINS - 1U, static_cast<uint>((position[axis] - c_min[axis]) * scale))];
+				bin.p_min = glm::min(bin.p_min, position);
+				bin.p_max = glm::max(bin.p_max, position);
+				bin.count++;
+			}
 
-	if (node->probes.empty()) {
-		for (uint i = 0; i < node->children.size(); i++) {
-			CPU_Bvh& child = node->children[i];
-			if (i < 4) {
-				bvh.pointers_a[i] = convertBvhSPH(&child);
+			// Right side sweep first, then the left side accumulates and evaluates each of the SAH_BINS - 1 planes
+			vec1 right_area[SAH_BINS];
+			uint right_count[SAH_BINS];
+			Sah_Bin right = Sah_Bin();
+			for (uint b = SAH_BINS - 1; b > 0; b--) {
+				right.p_min = glm::min(right.p_min, bins[b].p_min);
+				right.p_max = glm::max(right.p_max, bins[b].p_max);
+				right.count += bins[b].count;
+				right_area[b] = surfaceArea(right.p_min, right.p_max);
+				right_count[b] = right.count;
 			}
-			else {
-				bvh.pointers_b[i - 4] = convertBvhSPH(&child);
+			Sah_Bin left = Sah_Bin();
+			for (uint b = 1; b < SAH_BINS; b++) {
+				left.p_min = glm::min(left.p_min, bins[b - 1].p_min);
+				left.p_max = glm::max(left.p_max, bins[b - 1].p_max);
+				left.count += bins[b - 1].count;
+				if (left.count == 0 or right_count[b] == 0) {
+					continue;
+				}
+				const vec1 cost = SAH_TRAVERSAL_COST + (surfaceArea(left.p_min, left.p_max) * left.count + right_area[b] * right_count[b]) * inverse_area * SAH_INTERSECTION_COST;
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b;
+				}
 			}
 		}
 	}
-	else {
-		bvh.start =  ul_to_u(probes.size());
-		bvh.end =  ul_to_u(probes.size() + node->probes.size());
-		for (CPU_Probe* probe : node->probes) {
-			probes.push_back(probe);
-		}
+
+	// Coincident centroids cannot be split, they stay in one leaf whatever its size
+	if (best_axis < 0 or (best_cost >= leaf_cost and count <= SAH_MAX_LEAF)) {
+		nodes[index].first = start;
+		nodes[index].count = count | BVH_LEAF;
+		return;
 	}
 
-	nodes[index] = bvh;
-	if (node == &root_node) {
-		gpu_root_node = bvh;
+	const vec1 scale = SAH_BINS / (c_max[best_axis] - c_min[best_axis]);
+	const auto base = items.begin();
+	const uint middle = static_cast<uint>(partition(base + start, base + end, [&](const uint& item) {
+		return min(SAH_BINS - 1U, static_cast<uint>((positions[item][best_axis] - c_min[best_axis]) * scale)) < best_split;
+	}) - base);
+
+	// Siblings are allocated together, the two halves touch disjoint items and nodes so large ones split concurrently
+	const uint left = node_count.fetch_add(2U);
+	nodes[index].first = left;
+	nodes[index].count = 2;
+
+	if (count >= SAH_TASK_ITEMS) {
+		Task_Group group;
+		group.run([this, left, start, middle, depth]() { splitNode(left, start, middle, depth + 1); });
+		splitNode(left + 1, middle, end, depth + 1);
+		group.wait();
+	}
+	else {
+		splitNode(left, start, middle, depth + 1);
+		splitNode(left + 1, middle, end, depth + 1);
 	}
-	return index;
 }
 
-Bvh_Particle::Bvh_Particle(const vec3& p_min, const vec3& p_max, const vec3& center, const uint64& index, const CPU_Probe& part) :
-	center(center),
-	p_min(p_min),
-	p_max(p_max),
-	index(index),
-	part(part)
+Bvh_Traversal::Bvh_Traversal() :
+	nodes(0),
+	items(0),
+	hit(MAX_UINT32),
+	distance(MAX_VEC1)
 {}
 
-bool CPU_Bvh::operator==(const CPU_Bvh & other) const {
-	return p_min == other.p_min && p_max == other.p_max && discard == other.discard;
-}
-
-Particle_Builder::Particle_Builder(const vector<CPU_Particle*>& particles, const vec1& particle_radius, const uint& max_depth) :
-	source(particles),
-	particle_radius(particle_radius * 1.25f)
-{
-	for (CPU_Particle* particle : source) {
-		root_node.growToInclude(particle, particle_radius);
+vec1 f_intersectSphere(const vec3& origin, const vec3& direction, const vec3& center, const vec1& radius) {
+	const vec3 offset = origin - center;
+	const vec1 b = glm::dot(offset, direction);
+	const vec1 h = b * b - (glm::dot(offset, offset) - radius * radius);
+	if (h < 0.0f) {
+		return -1.0f;
 	}
-	root_node.discard = false;
-	depth_cutoff = max_depth;
-
-	splitBvh(&root_node, 0);
-
-	convertBvh(&root_node);
+	const vec1 root = sqrt(h);
+	if (-b - root >= 0.0f) {
+		return -b - root;
+	}
+	return -b + root >= 0.0f ? -b + root : -1.0f;
 }
 
-void Particle_Builder::splitBvh(CPU_Bvh* node, const uint& depth) {
-	node->split();
-
-	for (auto it = node->children.begin(); it != node->children.end(); ) {
-		CPU_Bvh& child = *it;
-
-#ifdef OPENMP
-		#pragma omp parallel for
-		int i = 0;
-		int i_size = ul_to_i(source.size());
-		for (i = 0; i < i_size; i++) {
-			if (child.contains(source[i])) {
-				#pragma omp critical
-				{
-					child.item_count++;
-					if (child.item_count > ITEM_COUNT) {
-						break;
-					}
-				}
-			}
+Bvh_Traversal f_traverseBvh(const vector<GPU_Bvh>& nodes, const vector<uint>& items, const vector<vec3>& positions, const vec3& origin, const vec3& direction, const vec1& radius) {
+	Bvh_Traversal result = Bvh_Traversal();
+	const vec3 inverse_direction = 1.0f / direction;
+
+	vector<int> stack = { 0 };
+	while (!stack.empty()) {
+		const GPU_Bvh& node = nodes[stack.back()];
+		stack.pop_back();
+		result.nodes++;
+
+		const vec3 t_a = (node.p_min - radius - origin) * inverse_direction;
+		const vec3 t_b = (node.p_max + radius - origin) * inverse_direction;
+		const vec3 t_near = glm::min(t_a, t_b);
+		const vec3 t_far  = glm::max(t_a, t_b);
+		const vec1 t0 = max(t_near.x, max(t_near.y, t_near.z));
+		const vec1 t1 = min(t_far.x, min(t_far.y, t_far.z));
+		if (t1 < max(t0, 0.0f)) {
+			continue;
 		}
-#else
-		for (const CPU_Particle* particle : source) {
-			if (child.contains(particle)) {
-				child.discard = false;
-				child.item_count++;
-				if (child.item_count > ITEM_COUNT) {
-					break;
-				}
-			}
-		}
-#endif
-		if (child.discard == false or child.item_count > 0) {
-			if (depth < depth_cutoff and child.item_count > ITEM_COUNT) {
-				splitBvh(&child, depth + 1);
-			}
-			else {
-#ifdef OPENMP
-				#pragma omp parallel for
-				int i = 0;
-				int i_size = ul_to_i(source.size());
-				for (i = 0; i < i_size; i++) {
-					if (child.contains(source[i])) {
-						#pragma omp critical
-						{
-							child.source.push_back(source[i]);
-						}
-					}
-				}
-#else
-				for (CPU_Particle* particle : source) {
-					if (child.contains(particle)) {
-						child.particles.push_back(particle);
-					}
+
+		if (node.isLeaf()) {
+			result.items += node.size();
+			for (uint i = node.first; i < node.first + node.size(); i++) {
+				const vec1 distance = f_intersectSphere(origin, direction, positions[items[i]], radius);
+				if (distance >= 0.0f and distance < result.distance) {
+					result.distance = distance;
+					result.hit = items[i];
 				}
-#endif
 			}
-			++it;
 		}
 		else {
-			it = node->children.erase(it);
+			for (uint i = 0; i < node.count; i++) {
+				stack.push_back(u_to_i(node.first + i));
+			}
 		}
 	}
+	return result;
 }
 
-uint Particle_Builder::convertBvh(CPU_Bvh* node) {
-	auto bvh = GPU_Bvh();
-	bvh.p_min = node->p_min - particle_radius;
-	bvh.p_max = node->p_max + particle_radius;
-
-	uint index = ul_to_u(nodes.size());
-	nodes.push_back(bvh);
-
-	if (node->particles.empty()) {
-		for (uint i = 0; i < node->children.size(); i++) {
-			CPU_Bvh& child = node->children[i];
-			if (i < 4) {
-				bvh.pointers_a[i] = convertBvh(&child);
+bool f_validateBvh(const vector<GPU_Bvh>& nodes, const uint& item_count) {
+	if (nodes.empty()) {
+		return false;
+	}
+	vector<uint8> node_seen(nodes.size(), 0);
+	vector<uint8> item_seen(item_count, 0);
+	vector<uint> stack = { 0 };
+	while (!stack.empty()) {
+		const uint index = stack.back();
+		stack.pop_back();
+		if (node_seen[index]++) {
+			return false;
+		}
+		const GPU_Bvh& node = nodes[index];
+		if (node.isLeaf()) {
+			if (u_to_ul(node.first) + node.size() > item_count) {
+				return false;
 			}
-			else {
-				bvh.pointers_b[i - 4] = convertBvh(&child);
+			for (uint i = node.first; i < node.first + node.size(); i++) {
+				if (item_seen[i]++) {
+					return false;
+				}
 			}
+			continue;
 		}
-	}
-	else {
-		bvh.start =  ul_to_u(particles.size());
-		bvh.end =  ul_to_u(particles.size() + node->particles.size());
-		for (CPU_Particle* particle : node->particles) {
-			particles.push_back(particle);
+		if (u_to_ul(node.first) + node.count > nodes.size() or (node.count > 0 and node.first <= index)) {
+			return false;
+		}
+		for (uint i = node.first; i < node.first + node.count; i++) {
+			const GPU_Bvh& child = nodes[i];
+			if (glm::any(glm::lessThan(child.p_min, node.p_min)) or glm::any(glm::greaterThan(child.p_max, node.p_max))) {
+				return false;
+			}
+			stack.push_back(i);
 		}
 	}
-
-	nodes[index] = bvh;
-	if (node == &root_node) {
-		gpu_root_node = bvh;
-	}
-	return index;
+	return static_cast<uint>(count(item_seen.begin(), item_seen.end(), 1)) == item_count;
 }
\ No newline at end of file
@@ -3,83 +3,111 @@
 #include "Shared.hpp"
 #include "Particle.hpp"
 
-struct CPU_Bvh;
+// Set in GPU_Bvh::count when the node is a leaf, the low bits then hold its item count
+#define BVH_LEAF 0x80000000U
 
-struct CPU_Bvh {
-	vec3 p_min;
-	vec3 p_max;
-	CPU_Bvh* parent;
-	vector<CPU_Probe*> probes;
-	vector<CPU_Particle*> particles;
-	vector<CPU_Bvh> children;
-	uint item_count;
-	bool discard;
-
-	CPU_Bvh();
-	CPU_Bvh(const vec3& pmin, const vec3& pmax);
-
-	void growToInclude(const vec3& min, const vec3& max);
-	vec3 getSize() const;
-	vec3 getCenter() const;
-	void growToInclude(const CPU_Probe* probe, const vec1& radius);
-	bool contains(const CPU_Probe* probe);
-	void growToInclude(const CPU_Particle* particle, const vec1& radius);
-	bool contains(const CPU_Particle* particle);
-	void split();
-	bool operator==(const CPU_Bvh& other) const;
+enum struct Bvh_Type {
+	OCTREE,
+	LBVH,
+	SAH
 };
 
+// 32 bytes, the children of a node are contiguous so one index and a count address all of them
 struct alignas(16) GPU_Bvh {
-	vec3  p_min;
-	uint  start;
-	vec3  p_max;
-	uint  end;
-	ivec4 pointers_a;
-	ivec4 pointers_b;
+	vec3 p_min;
+	uint first; // First child, or first item of a leaf
+	vec3 p_max;
+	uint count; // Child count, or item count | BVH_LEAF
 
 	GPU_Bvh();
+
+	bool isLeaf() const;
+	uint size() const;
 };
 
-struct Bvh_Particle {
-	vec3   p_min;
-	vec3   p_max;
-	vec3   center;
-	uint64 index;
-	CPU_Probe part;
-	Bvh_Particle(const vec3& p_min, const vec3& p_max, const vec3& center, const uint64& index, const CPU_Probe& part);
+struct Octree_Node {
+	vec3 p_min;
+	vec3 p_max;
+	uint start;
+	uint end;
+	uint first_child;
+	uint child_count;
+
+	Octree_Node(const vec3& p_min, const vec3& p_max, const uint& start, const uint& end);
 };
 
-struct Builder {
-	vector<CPU_Probe*> source;
-	vector<CPU_Probe*> probes;
-	CPU_Bvh root_node;
-	uint depth_cutoff;
-	vec1 particle_radius;
+// Octree over a single index array partitioned in place, so every level costs O(n) and the items of a node stay contiguous.
+// Nodes come from an arena that is reset per build but keeps its capacity, the children of a node are allocated together.
+struct Octree_Builder {
+	vector<Octree_Node> arena;
+	vector<uint>        items;
+	vector<GPU_Bvh>     nodes;
+	uint max_depth;
 
+	Octree_Builder();
+
+	void build(const vector<vec3>& positions, const uint& max_depth);
+	void splitNode(const uint& index, const vector<vec3>& positions, const uint& depth);
+	void convertNodes();
+};
 
-	GPU_Bvh gpu_root_node;
+// Linear BVH [Karras 2012, Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees]
+// Primitives are sorted by Morton code, internal node i and the leaves are emitted independently,
+// bounds are then merged bottom-up. The Karras layout is then reordered so siblings are contiguous, root at index 0.
+struct Lbvh_Builder {
+	vector<uint64>  codes;
+	vector<uint>    items;
+	vector<uint>    parents;
+	vector<uvec2>   children;
 	vector<GPU_Bvh> nodes;
+	uint key_bits;
 
-	Builder(const vector<CPU_Probe*>& probes, const vec1& probe_radius, const uint& max_depth);
+	Lbvh_Builder(const vector<vec3>& positions);
 
-	void splitBvh(CPU_Bvh* node, const uint& depth);
-	uint convertBvh(CPU_Bvh* node);
-	void growBvhSPH(CPU_Bvh* node);
-	uint convertBvhSPH(CPU_Bvh* node);
+	void sortCodes();
+	void buildNode(const uint& index);
+	void growBounds(const uint& leaf, const vec3& position, vector<atomic<uint>>& visits);
+	int  prefixLength(const int& a, const int& b) const;
+	void compactNodes();
 };
 
-struct Particle_Builder {
-	vector<CPU_Particle*> source;
-	vector<CPU_Particle*> particles;
-	CPU_Bvh root_node;
-	uint depth_cutoff;
-	vec1 particle_radius;
+struct Sah_Bin {
+	vec3 p_min;
+	vec3 p_max;
+	uint count;
 
-	GPU_Bvh gpu_root_node;
+	Sah_Bin();
+};
+
+// Binned surface area heuristic BVH, splits are chosen per node from a traversal / intersection cost model,
+// which also decides when a node becomes a leaf, so there is no depth or leaf size setting. Binary nodes, root at index 0.
+// Areas are measured on the bounds grown by cost_radius, the stored bounds are not. Large subtrees are built as jobs, so node order varies between builds.
+struct Sah_Builder {
+	const vector<vec3>& positions;
+	vec1 cost_radius;
+	vector<uint>    items;
 	vector<GPU_Bvh> nodes;
+	atomic<uint>    node_count;
+
+	Sah_Builder(const vector<vec3>& positions, const vec1& cost_radius);
 
-	Particle_Builder(const vector<CPU_Particle*>& particles, const vec1& particle_radius, const uint& max_depth);
+	void splitNode(const uint& index, const uint& start, const uint& end, const uint& depth);
+	vec1 surfaceArea(const vec3& p_min, const vec3& p_max) const;
+};
+
+// Nodes and leaf items a ray touches while walking a BVH the way the shader does, and the nearest item it hits
+struct Bvh_Traversal {
+	uint nodes;
+	uint items;
+	uint hit; // Position index, MAX_UINT32 on a miss
+	vec1 distance;
+
+	Bvh_Traversal();
+};
 
-	void splitBvh(CPU_Bvh* node, const uint& depth);
-	uint convertBvh(CPU_Bvh* node);
-};
\ No newline at end of file
+// Distance along a normalized direction to the first sphere surface in front of the origin, -1 on a miss
+vec1 f_intersectSphere(const vec3& origin, const vec3& direction, const vec3& center, const vec1& radius);
+// Bounds hold item positions only, the item radius is added to every box at traversal. Leaves index items, which index positions.
+Bvh_Traversal f_traverseBvh(const vector<GPU_Bvh>& nodes, const vector<uint>& items, const vector<vec3>& positions, const vec3& origin, const vec3& direction, const vec1& radius);
+// Reference walk of the whole tree: indices in range, every node and item reached once, children inside their parent
+bool f_validateBvh(const vector<GPU_Bvh>& nodes, const uint& item_count);
\ No newline at end of file
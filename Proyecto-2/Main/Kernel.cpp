@@ -9,21 +9,83 @@
 
 #define CORIOLIS           vec3(15.0, 0, 0)
 
+// Wind is in m/s, positions in Mm and a simulated time unit is 864 s (DAY_TIME advances 0.01 per unit)
+#define WIND_TO_BODY        0.000864
+#define MAX_SUBSTEP_HEATING 1.0 // K a substep may move a probe temperature by
+
+// First f_randD draw of each use, particles and probes share entity indices so every use keeps its own draw range
+#define RNG_PARTICLE_ORIENTATION 0 // Draws 0 - 3
+#define RNG_PROBE_WIND           4 // Draws 4 - 6
+
+// Probes per batch of the simulation stages, contiguous ranges keep the per-field loops vectorizable
+#define PROBE_BATCH 1024
+
+Precision_Report::Precision_Report() :
+	substeps(0),
+	temperature(0.0),
+	pressure(0.0),
+	wind(0.0),
+	relative(0.0)
+{}
+
+Step_Control::Step_Control() :
+	sub_samples(1),
+	stable_dt(0.0),
+	advection(0.0),
+	relaxation(0.0),
+	heating(0.0),
+	capped(false)
+{}
+
+Kernel_Timings::Kernel_Timings() :
+	probe_bvh(0.0),
+	particle_sort(0.0),
+	scatter(0.0),
+	gather(0.0),
+	particle_update(0.0)
+{}
+
+static dvec1 f_elapsed(const chrono::high_resolution_clock::time_point& start) {
+	return chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+}
+
+uint f_gpuBlock(const uint& flag) {
+	uint block = 0;
+	while ((1U << block) != flag) {
+		block++;
+	}
+	return block;
+}
+
+Kernel_Snapshot::Kernel_Snapshot() {
+	for (uint i = 0; i < GPU_BLOCKS; i++) {
+		versions[i] = 0;
+	}
+	time = 0.0;
+	earth_rotation = dquat(1, 0, 0, 0);
+	earth_tilt = 0.0;
+	year_time = 0.0;
+	day_time = 0.0;
+	calendar = ivec4(0);
+	max_smoothing_radius = 0.0f;
+	particle_probe_distance = 0.0f;
+}
+
 Kernel::Kernel() {
 	PARTICLE_RADIUS           = 0.01f;
 	PARTICLE_COUNT            = 16384;
-	PARTICLE_MAX_OCTREE_DEPTH = 1;
 	PARTICLE_POLE_BIAS        = 0.995;
 	PARTICLE_POLE_BIAS_POWER  = 7.5;
 	PARTICLE_POLE_GEOLOCATION = dvec2(25.0, 90.0);
 
 	PROBE_RADIUS           = 0.05f;
 	PROBE_COUNT            = 8192;
+	PROBE_NEIGHBORS        = 3;
 	PROBE_MAX_OCTREE_DEPTH = 1;
 	PROBE_POLE_BIAS        = 0.0;//0.975;
 	PROBE_POLE_BIAS_POWER  = 1.0;// 5.0;
 	PROBE_POLE_GEOLOCATION = dvec2(25.0, 90.0);
-	BVH_SPH                = false;
+	BVH_TYPE               = Bvh_Type::LBVH;
 
 	EARTH_TILT      = 23.5;
 	CALENDAR_DAY    = 21;
@@ -36,115 +98,298 @@ Kernel::Kernel() {
 	TIME_SCALE      = 1.0;
 	DT              = 0;
 	RUNFRAME        = 0;
-	SUB_SAMPLES     = 2;
+	MAX_SUB_SAMPLES = 200;
+	COURANT         = 0.5;
+	THREAD_COUNT    = JOBS.size();
+	EXACT_THERMODYNAMICS = false;
+	COMPARE_PRECISION    = false;
+	SEED            = 1337;
 	SDT             = 0;
 	sun_dir         = dvec3(0, 0, 1);
+	earth_rotation  = dquat(1, 0, 0, 0);
+	substep         = 0;
+	dirty           = 0;
+	gpu_dirty       = 0;
+	for (uint i = 0; i < GPU_BLOCKS; i++) {
+		gpu_versions[i] = 0;
+	}
+	max_smoothing_radius = 0.0f;
+	particle_probe_distance = 0.0f;
 	calculateDateTime();
 
+	// The maps are decoded in parallel on the job system and collected once all are queued
+	unordered_map<Texture_Field, future<Texture>> loading;
+	const auto load = [](const string& file_path, const Texture_Format& format) {
+		return f_async([file_path, format]() { return Texture::fromFile(file_path, format); });
+	};
 #ifdef NDEBUG
-	textures[Texture_Field::TOPOGRAPHY]                     = Texture::fromFile("./Resources/Data/Topography.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::BATHYMETRY]                     = Texture::fromFile("./Resources/Data/Bathymetry.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SURFACE_PRESSURE]               = Texture::fromFile("./Resources/Data/Pressure CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SEA_SURFACE_TEMPERATURE_DAY]    = Texture::fromFile("./Resources/Data/Sea Surface Temperature CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT]  = Texture::fromFile("./Resources/Data/Sea Surface Temperature Night CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::LAND_SURFACE_TEMPERATURE_DAY]   = Texture::fromFile("./Resources/Data/Land Surface Temperature CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT] = Texture::fromFile("./Resources/Data/Land Surface Temperature Night CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::TOPOGRAPHY]                     = load("./Resources/Data/Topography.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::BATHYMETRY]                     = load("./Resources/Data/Bathymetry.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SURFACE_PRESSURE]               = load("./Resources/Data/Pressure CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SEA_SURFACE_TEMPERATURE_DAY]    = load("./Resources/Data/Sea Surface Temperature CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT]  = load("./Resources/Data/Sea Surface Temperature Night CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::LAND_SURFACE_TEMPERATURE_DAY]   = load("./Resources/Data/Land Surface Temperature CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT] = load("./Resources/Data/Land Surface Temperature Night CAF.png", Texture_Format::MONO_FLOAT);
 	
-	textures[Texture_Field::HUMIDITY]                = Texture::fromFile("./Resources/Data/Humidity CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::WATER_VAPOR]             = Texture::fromFile("./Resources/Data/Water Vapor CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_COVERAGE]          = Texture::fromFile("./Resources/Data/Cloud Fraction.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_WATER_CONTENT]     = Texture::fromFile("./Resources/Data/Cloud Water Content CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_PARTICLE_RADIUS]   = Texture::fromFile("./Resources/Data/Cloud Particle Radius CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_OPTICAL_THICKNESS] = Texture::fromFile("./Resources/Data/Cloud Optical Thickness CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::HUMIDITY]                = load("./Resources/Data/Humidity CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::WATER_VAPOR]             = load("./Resources/Data/Water Vapor CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_COVERAGE]          = load("./Resources/Data/Cloud Fraction.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_WATER_CONTENT]     = load("./Resources/Data/Cloud Water Content CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_PARTICLE_RADIUS]   = load("./Resources/Data/Cloud Particle Radius CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_OPTICAL_THICKNESS] = load("./Resources/Data/Cloud Optical Thickness CAF.png", Texture_Format::MONO_FLOAT);
 	
-	textures[Texture_Field::OZONE]                         = Texture::fromFile("./Resources/Data/Ozone CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::ALBEDO]                        = Texture::fromFile("./Resources/Data/Albedo CAF.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::UV_INDEX]                      = Texture::fromFile("./Resources/Data/UV Index.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::NET_RADIATION]                 = Texture::fromFile("./Resources/Data/Net Radiation.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SOLAR_INSOLATION]              = Texture::fromFile("./Resources/Data/Solar Insolation.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::OUTGOING_LONGWAVE_RADIATION]   = Texture::fromFile("./Resources/Data/Outgoing Longwave Radiation.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::REFLECTED_SHORTWAVE_RADIATION] = Texture::fromFile("./Resources/Data/Reflected Shortwave Radiation.png", Texture_Format::MONO_FLOAT);
-
-	textures[Texture_Field::WIND_VECTOR] = Texture::fromFile("./Resources/Data/Wind.png", Texture_Format::RGBA_8);
+	loading[Texture_Field::OZONE]                         = load("./Resources/Data/Ozone CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::ALBEDO]                        = load("./Resources/Data/Albedo CAF.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::UV_INDEX]                      = load("./Resources/Data/UV Index.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::NET_RADIATION]                 = load("./Resources/Data/Net Radiation.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SOLAR_INSOLATION]              = load("./Resources/Data/Solar Insolation.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::OUTGOING_LONGWAVE_RADIATION]   = load("./Resources/Data/Outgoing Longwave Radiation.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::REFLECTED_SHORTWAVE_RADIATION] = load("./Resources/Data/Reflected Shortwave Radiation.png", Texture_Format::MONO_FLOAT);
+
+	loading[Texture_Field::WIND_VECTOR] = load("./Resources/Data/Wind.png", Texture_Format::RGBA_8);
 #else
-	textures[Texture_Field::TOPOGRAPHY]                     = Texture::fromFile("./Resources/Data/Topography LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::BATHYMETRY]                     = Texture::fromFile("./Resources/Data/Bathymetry LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SURFACE_PRESSURE]               = Texture::fromFile("./Resources/Data/Pressure LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SEA_SURFACE_TEMPERATURE_DAY]    = Texture::fromFile("./Resources/Data/Sea Surface Temperature LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT]  = Texture::fromFile("./Resources/Data/Sea Surface Temperature Night LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::LAND_SURFACE_TEMPERATURE_DAY]   = Texture::fromFile("./Resources/Data/Land Surface Temperature LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT] = Texture::fromFile("./Resources/Data/Land Surface Temperature Night LR.png", Texture_Format::MONO_FLOAT);
-
-	textures[Texture_Field::HUMIDITY]                = Texture::fromFile("./Resources/Data/Humidity LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::WATER_VAPOR]             = Texture::fromFile("./Resources/Data/Water Vapor LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_COVERAGE]          = Texture::fromFile("./Resources/Data/Cloud Fraction LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_WATER_CONTENT]     = Texture::fromFile("./Resources/Data/Cloud Water Content LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_PARTICLE_RADIUS]   = Texture::fromFile("./Resources/Data/Cloud Particle Radius LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::CLOUD_OPTICAL_THICKNESS] = Texture::fromFile("./Resources/Data/Cloud Optical Thickness LR.png", Texture_Format::MONO_FLOAT);
-
-	textures[Texture_Field::OZONE]                         = Texture::fromFile("./Resources/Data/Ozone LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::ALBEDO]                        = Texture::fromFile("./Resources/Data/Albedo LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::UV_INDEX]                      = Texture::fromFile("./Resources/Data/UV Index LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::NET_RADIATION]                 = Texture::fromFile("./Resources/Data/Net Radiation LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::SOLAR_INSOLATION]              = Texture::fromFile("./Resources/Data/Solar Insolation LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::OUTGOING_LONGWAVE_RADIATION]   = Texture::fromFile("./Resources/Data/Outgoing Longwave Radiation LR.png", Texture_Format::MONO_FLOAT);
-	textures[Texture_Field::REFLECTED_SHORTWAVE_RADIATION] = Texture::fromFile("./Resources/Data/Reflected Shortwave Radiation LR.png", Texture_Format::MONO_FLOAT);
-
-	textures[Texture_Field::WIND_VECTOR] = Texture::fromFile("./Resources/Data/Wind.png", Texture_Format::RGBA_8);
+	loading[Texture_Field::TOPOGRAPHY]                     = load("./Resources/Data/Topography LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::BATHYMETRY]                     = load("./Resources/Data/Bathymetry LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SURFACE_PRESSURE]               = load("./Resources/Data/Pressure LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SEA_SURFACE_TEMPERATURE_DAY]    = load("./Resources/Data/Sea Surface Temperature LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT]  = load("./Resources/Data/Sea Surface Temperature Night LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::LAND_SURFACE_TEMPERATURE_DAY]   = load("./Resources/Data/Land Surface Temperature LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT] = load("./Resources/Data/Land Surface Temperature Night LR.png", Texture_Format::MONO_FLOAT);
+
+	loading[Texture_Field::HUMIDITY]                = load("./Resources/Data/Humidity LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::WATER_VAPOR]             = load("./Resources/Data/Water Vapor LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_COVERAGE]          = load("./Resources/Data/Cloud Fraction LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_WATER_CONTENT]     = load("./Resources/Data/Cloud Water Content LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_PARTICLE_RADIUS]   = load("./Resources/Data/Cloud Particle Radius LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::CLOUD_OPTICAL_THICKNESS] = load("./Resources/Data/Cloud Optical Thickness LR.png", Texture_Format::MONO_FLOAT);
+
+	loading[Texture_Field::OZONE]                         = load("./Resources/Data/Ozone LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::ALBEDO]                        = load("./Resources/Data/Albedo LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::UV_INDEX]                      = load("./Resources/Data/UV Index LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::NET_RADIATION]                 = load("./Resources/Data/Net Radiation LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::SOLAR_INSOLATION]              = load("./Resources/Data/Solar Insolation LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::OUTGOING_LONGWAVE_RADIATION]   = load("./Resources/Data/Outgoing Longwave Radiation LR.png", Texture_Format::MONO_FLOAT);
+	loading[Texture_Field::REFLECTED_SHORTWAVE_RADIATION] = load("./Resources/Data/Reflected Shortwave Radiation LR.png", Texture_Format::MONO_FLOAT);
+
+	loading[Texture_Field::WIND_VECTOR] = load("./Resources/Data/Wind.png", Texture_Format::RGBA_8);
 #endif
+	for (auto& texture : loading) {
+		textures[texture.first] = texture.second.get();
+	}
+
+	texture_fields.assign(static_cast<uint64>(Texture_Field::WIND_VECTOR) + 1, nullptr);
+	for (const auto& texture : textures) {
+		texture_fields[static_cast<uint64>(texture.first)] = &texture.second;
+	}
 }
 
 void Kernel::updateGPUProbes() {
-	START_TIMER("Probe BVH");
-	const Builder bvh_build = BVH_SPH ? Builder(probes, -1.0f, 1): Builder(probes, d_to_f(PROBE_RADIUS), PROBE_MAX_OCTREE_DEPTH);
-	probe_nodes = bvh_build.nodes;
+	const auto start_time = chrono::high_resolution_clock::now();
+	// Bounds only hold the probe positions, the display or smoothing radius is added at traversal
+	vector<vec3> positions;
+	positions.reserve(probes.size());
+	for (uint i = 0; i < probes.size(); i++) {
+		positions.push_back(d_to_f(probes.position[i]));
+	}
+	if (BVH_TYPE == Bvh_Type::LBVH) {
+		const Lbvh_Builder bvh_build = Lbvh_Builder(positions);
+		probe_nodes = bvh_build.nodes;
+		probe_order = bvh_build.items;
+	}
+	else if (BVH_TYPE == Bvh_Type::SAH) {
+		const Sah_Builder bvh_build = Sah_Builder(positions, PROBE_RADIUS);
+		probe_nodes = bvh_build.nodes;
+		probe_order = bvh_build.items;
+	}
+	else {
+		probe_octree.build(positions, PROBE_MAX_OCTREE_DEPTH);
+		probe_nodes = probe_octree.nodes;
+		probe_order = probe_octree.items;
+	}
+	probe_slot.resize(probe_order.size());
+	for (uint slot = 0; slot < len32(probe_order); slot++) {
+		probe_slot[probe_order[slot]] = slot;
+	}
+	timings.probe_bvh += f_elapsed(start_time);
+	gpu_dirty |= GPU_PROBE_NODES;
+
+	updateGPUProbeData();
+}
 
+void Kernel::updateGPUProbeData() {
+	// Probes are fixed in the body frame, so the BVH order stays valid and only the fields are refreshed
 	gpu_probes.clear();
-	for (const CPU_Probe* probe : bvh_build.probes) {
-		gpu_probes.push_back(GPU_Probe(probe));
+	gpu_probes.reserve(probe_order.size());
+	for (const uint& index : probe_order) {
+		gpu_probes.push_back(GPU_Probe(probes, index));
 	}
-	END_TIMER("Probe BVH");
+	gpu_dirty |= GPU_PROBES;
+	updateGPUProbeStates();
+	updateParticleRanges();
+}
+
+void Kernel::updateGPUProbeStates() {
+	gpu_probe_states.resize(probe_order.size());
+	f_parallelFor(0, len32(probe_order), [&](const uint& i) {
+		gpu_probe_states[i] = GPU_Probe_State(probes, probe_order[i]);
+	});
+	gpu_dirty |= GPU_PROBE_STATES;
+}
+
+void Kernel::benchmarkBvh(const uint& ray_count) const {
+	vector<vec3> positions;
+	positions.reserve(probes.size());
+	for (uint i = 0; i < probes.size(); i++) {
+		positions.push_back(d_to_f(probes.position[i]));
+	}
+
+	// Same seeded camera rays for every builder, cast from an orbit at 15mm towards points on the probe shell
+	mt19937 gen(1337);
+	uniform_real_distribution<vec1> dis(-1.0f, 1.0f);
+	const vec1 shell = 6.371f + PROBE_RADIUS;
+	vector<vec3> origins;
+	vector<vec3> directions;
+	for (uint i = 0; i < ray_count; i++) {
+		const vec3 origin = glm::normalize(vec3(dis(gen), dis(gen), dis(gen)) + vec3(0.0f, 0.0f, 1e-6f)) * 15.0f;
+		const vec3 target = glm::normalize(vec3(dis(gen), dis(gen), dis(gen)) + vec3(0.0f, 0.0f, 1e-6f)) * shell * (1.0f + dis(gen) * 0.05f);
+		origins.push_back(origin);
+		directions.push_back(glm::normalize(target - origin));
+	}
+
+	Octree_Builder octree;
+	octree.build(positions, PROBE_MAX_OCTREE_DEPTH);
+	const Lbvh_Builder lbvh = Lbvh_Builder(positions);
+	const Sah_Builder sah = Sah_Builder(positions, PROBE_RADIUS);
+
+	// Ground truth nearest hit of every ray against all probes
+	vector<uint> reference_hits(ray_count, MAX_UINT32);
+	vector<vec1> reference_distances(ray_count, MAX_VEC1);
+	f_parallelFor(0, ray_count, [&](const uint& i) {
+		for (uint probe = 0; probe < len32(positions); probe++) {
+			const vec1 distance = f_intersectSphere(origins[i], directions[i], positions[probe], PROBE_RADIUS);
+			if (distance >= 0.0f and distance < reference_distances[i]) {
+				reference_distances[i] = distance;
+				reference_hits[i] = probe;
+			}
+		}
+	});
+
+	cout << "BVH Benchmark: " << probes.size() << " probes, " << ray_count << " rays" << endl;
+	const auto report = [&](const string& name, const vector<GPU_Bvh>& tree, const vector<uint>& items) {
+		uint64 nodes = 0;
+		uint64 tested = 0;
+		uint mismatches = 0;
+		for (uint i = 0; i < ray_count; i++) {
+			const Bvh_Traversal traversal = f_traverseBvh(tree, items, positions, origins[i], directions[i], PROBE_RADIUS);
+			nodes += traversal.nodes;
+			tested += traversal.items;
+			// Equidistant probes may resolve either way, only a different distance is a wrong hit
+			if (traversal.hit != reference_hits[i] and (traversal.hit == MAX_UINT32 or reference_hits[i] == MAX_UINT32 or abs(traversal.distance - reference_distances[i]) > 1e-5f)) {
+				mismatches++;
+			}
+		}
+		cout << "  " << name << ": " << (f_validateBvh(tree, probes.size()) ? "valid, " : "INVALID, ") << tree.size() << " nodes, "
+			<< ul_to_d(nodes) / max(1U, ray_count) << " nodes visited / ray, "
+			<< ul_to_d(tested) / max(1U, ray_count) << " probes tested / ray, "
+			<< mismatches << " hits differing from brute force" << endl;
+	};
+	report("Octree", octree.nodes, octree.items);
+	report("LBVH", lbvh.nodes, lbvh.items);
+	report("SAH", sah.nodes, sah.items);
 }
 
 void Kernel::buildProbes() {
 	cout << "Rebuild Probes" << endl;
 	const dvec1 radius = 6.371 + PROBE_RADIUS;
 	sun_dir = sunDir();
+	earth_rotation = earthRotation();
 
-	for (CPU_Probe* ptr : probes) {
-		delete ptr;
-	}
-	probes.clear();
-	for (uint i = 0; i < PROBE_COUNT; i++) {
-		CPU_Probe* probe = new CPU_Probe();
-		const dvec1 normalized_i = i / (dvec1)(PROBE_COUNT - 1);
+	probes.resize(PROBE_COUNT);
+	f_parallelFor(0, PROBE_COUNT, [&](const uint& index) {
+		const dvec1 normalized_i = index / (dvec1)(PROBE_COUNT - 1);
 		const dvec1 biased_i = (1.0 - PROBE_POLE_BIAS) * normalized_i + PROBE_POLE_BIAS * pow(normalized_i, PROBE_POLE_BIAS_POWER);
 
 		const dvec1 theta = acos(1.0 - 2.0 * biased_i);
-		const dvec1 phi = dvec1(i) * (glm::pi<dvec1>() * (3.0 - sqrt(5.0)));
+		const dvec1 phi = dvec1(index) * (glm::pi<dvec1>() * (3.0 - sqrt(5.0)));
 
 		const dvec1 x = radius * sin(theta) * cos(phi);
 		const dvec1 y = radius * cos(theta);
 		const dvec1 z = radius * sin(theta) * sin(phi);
 
-		probe->data.position = rotateGeoloc(dvec3(x, y, z), PROBE_POLE_GEOLOCATION);
-		updateProbePosition(probe);
-		traceInitProperties(probe);
-		probe->gen_index = i;
-		probes.push_back(probe);
-	}
+		probes.position[index] = rotateGeoloc(dvec3(x, y, z), PROBE_POLE_GEOLOCATION);
+		probes.gen_index[index] = index;
+		updateProbePosition(probes, index);
+
+		// The tilt and day rotation of the surface normal cancel against the day offset of the equirectangular maps,
+		// so the coordinates only depend on the body frame position
+		const dvec3 normal = glm::normalize(probes.position[index]);
+		const dvec1 latitude = acos(normal.y);
+		const dvec1 longitude = glm::atan(normal.z, normal.x);
+		probes.uv[index] = d_to_f(dvec2(glm::fract(1.0 - ((longitude + PI) / TWO_PI)), latitude / PI));
+	});
+	sampleProbes();
+	// Particles keep probe indices, so they are rebound to the new probes
+	buildProbeTree();
+	lockParticles();
+	resetComparison();
 }
 
 void Kernel::updateGPUParticles() {
-	START_TIMER("Particle BVH");
-	const Particle_Builder bvh_build = Particle_Builder(particles, d_to_f(PARTICLE_RADIUS), PROBE_MAX_OCTREE_DEPTH);
-	particle_nodes = bvh_build.nodes;
+	const auto start_time = chrono::high_resolution_clock::now();
+	// Counting sort by the BVH slot of the owning probe, a probe BVH leaf then covers one contiguous particle range
+	const uint slot_count = len32(probe_order);
+	particle_offsets.assign(slot_count + 1, 0);
+	particle_probe_distance = 0.0f;
+
+	if (slot_count > 0) {
+		vector<uint> slots(particles.size());
+		for (uint i = 0; i < len32(particles); i++) {
+			CPU_Particle* particle = particles[i];
+			const dvec3 body_position = particle->rotation * particle->position;
+			if (particle->probe >= probes.size()) {
+				particle->probe = closestProbe(body_position);
+			}
+			slots[i] = probe_slot[particle->probe];
+			particle_offsets[slots[i] + 1]++;
+			particle_probe_distance = max(particle_probe_distance, d_to_f(glm::distance(body_position, probes.position[particle->probe])));
+		}
+		for (uint slot = 0; slot < slot_count; slot++) {
+			particle_offsets[slot + 1] += particle_offsets[slot];
+		}
+
+		vector<uint> cursors(particle_offsets.begin(), particle_offsets.end() - 1);
+		vector<CPU_Particle*> sorted(particles.size());
+		for (uint i = 0; i < len32(particles); i++) {
+			sorted[cursors[slots[i]]++] = particles[i];
+		}
+		particles.swap(sorted);
+	}
 
 	gpu_particles.clear();
-	for (const CPU_Particle* particle : bvh_build.particles) {
+	gpu_particles.reserve(particles.size());
+	gpu_particle_ids.clear();
+	gpu_particle_ids.reserve(particles.size());
+	gpu_particle_rotations.resize(particles.size());
+	for (const CPU_Particle* particle : particles) {
 		gpu_particles.push_back(GPU_Particle(particle));
+		gpu_particle_ids.push_back(particle->id);
+		gpu_particle_rotations[particle->id] = d_to_f(particle->rotation);
+	}
+	gpu_dirty |= GPU_PARTICLES;
+	updateParticleRanges();
+	timings.particle_sort += f_elapsed(start_time);
+}
+
+void Kernel::updateParticleRanges() {
+	// Empty until the particles are sorted against the current probe order
+	gpu_probe_ranges.assign(probe_order.size(), uvec2(0));
+	gpu_dirty |= GPU_PROBE_RANGES;
+	if (particle_offsets.size() != probe_order.size() + 1) {
+		return;
+	}
+	for (uint slot = 0; slot < len32(probe_order); slot++) {
+		gpu_probe_ranges[slot] = uvec2(particle_offsets[slot], particle_offsets[slot + 1]);
 	}
-	END_TIMER("Particle BVH");
 }
 
 void Kernel::buildParticles() {
@@ -168,141 +413,266 @@ void Kernel::buildParticles() {
 		const dvec1 y = radius * cos(theta);
 		const dvec1 z = radius * sin(theta) * sin(phi);
 
+		particle->id = i;
 		particle->position = rotateGeoloc(dvec3(x, y, z), PARTICLE_POLE_GEOLOCATION);
+		particle->wind_speed = glm::normalize(dquat(f_randD(SEED, i, 0, RNG_PARTICLE_ORIENTATION), f_randD(SEED, i, 0, RNG_PARTICLE_ORIENTATION + 1), f_randD(SEED, i, 0, RNG_PARTICLE_ORIENTATION + 2), f_randD(SEED, i, 0, RNG_PARTICLE_ORIENTATION + 3)));
 		updateParticlePosition(particle);
 		particles.push_back(particle);
 	}
+	gpu_particle_anchors.resize(particles.size());
+	for (const CPU_Particle* particle : particles) {
+		gpu_particle_anchors[particle->id] = d_to_f(particle->position);
+	}
+	gpu_dirty |= GPU_PARTICLE_ANCHORS;
+	lockParticles();
+}
+
+void Kernel::invalidate(const uint& flags) {
+	dirty |= flags;
+}
+
+// Only the blocks the target slot has not seen yet are copied, a slot skipped by the renderer catches up on its next fill
+void Kernel::snapshot(Kernel_Snapshot& target) {
+	for (uint i = 0; i < GPU_BLOCKS; i++) {
+		if (gpu_dirty & (1U << i)) {
+			gpu_versions[i]++;
+		}
+	}
+	gpu_dirty = 0;
+	const auto stale = [&](const uint& flag) {
+		return target.versions[f_gpuBlock(flag)] != gpu_versions[f_gpuBlock(flag)];
+	};
+	if (stale(GPU_PROBES)) {
+		target.probes = gpu_probes;
+	}
+	if (stale(GPU_PROBE_STATES)) {
+		target.probe_states = gpu_probe_states;
+	}
+	if (stale(GPU_PROBE_RANGES)) {
+		target.probe_ranges = gpu_probe_ranges;
+	}
+	if (stale(GPU_PROBE_NODES)) {
+		target.probe_nodes = probe_nodes;
+	}
+	if (stale(GPU_PARTICLES)) {
+		target.particles = gpu_particles;
+		target.particle_ids = gpu_particle_ids;
+		target.particle_rotations = gpu_particle_rotations;
+	}
+	if (stale(GPU_PARTICLE_ANCHORS)) {
+		target.particle_anchors = gpu_particle_anchors;
+	}
+	for (uint i = 0; i < GPU_BLOCKS; i++) {
+		target.versions[i] = gpu_versions[i];
+	}
+
+	target.earth_rotation = earth_rotation;
+	target.earth_tilt = EARTH_TILT;
+	target.year_time = YEAR_TIME;
+	target.day_time = DAY_TIME;
+	target.calendar = ivec4(CALENDAR_MONTH, CALENDAR_DAY, CALENDAR_HOUR, CALENDAR_MINUTE);
+	target.max_smoothing_radius = max_smoothing_radius;
+	target.particle_probe_distance = particle_probe_distance;
+	target.precision_report = precision_report;
+	target.step_control = step_control;
+	target.timings = timings;
+}
+
+// Texture coordinates are body frame, so a date or tilt change keeps the samples, neighbors, BVH and simulated fields,
+// only the sun, the rotation and what is derived from them are updated, the wind rotation included as it carries the tilt
+void Kernel::resampleTime() {
+	sun_dir = sunDir();
+	earth_rotation = earthRotation();
+
+	Probe_State& data = probes.current();
+	f_parallelFor(0, probes.size(), [&](const uint& index) {
+		updateProbePosition(probes, index);
+		calculateSunlight(probes, index, index + 1);
+		data.sun_intensity[index] = probes.next().sun_intensity[index];
+		data.solar_irradiance[index] = probes.next().solar_irradiance[index];
+		probes.wind_quaternion[index] = windRotation(probes.wind_u[index], probes.wind_v[index]);
+	});
+
+	f_parallelFor(0, len32(particles), [&](const uint& i) {
+		updateParticlePosition(particles[i]);
+	});
+	resetComparison();
 }
 
 void Kernel::lock() {
 	//textures.clear();
+	substep = 0;
+	buildProbeTree();
 	lockProbes();
 	lockParticles();
+	updateGPUProbeData();
+	resetComparison();
 }
 
-void Kernel::lockProbes() {
-	const int NUM_NEIGHBORS = 3;
+void Kernel::buildProbeTree() {
+	probe_tree.build(vector<dvec3>(probes.position.begin(), probes.position.end()));
+}
 
-	int i = 0;
-	int i_size = u_to_i(PROBE_COUNT);
-	#pragma omp parallel for private(i) num_threads(12)
-	for (i = 0; i < i_size; i++) {
-		CPU_Probe* probe = probes[i];
+void Kernel::lockProbes() {
+	// The smoothing radius reaches past the k-th neighbor, so one extra neighbor is queried
+	const uint neighbor_count = probes.size() > 1 ? min(PROBE_NEIGHBORS, probes.size() - 2) : 0;
+	probes.resizeNeighbors(neighbor_count);
+	Probe_State& data = probes.current();
 
-		vector<CPU_Neighbor> neighbors;
+	f_parallelFor(0, probes.size(), [&](const uint& index) {
+		const uint offset = probes.neighbor_offsets[index];
 
-		for (uint j = 0; j < PROBE_COUNT; j++) {
-			if (i != j) {
-				const dvec1 dist = glm::distance(probe->data.position, probes[j]->data.position);
-				neighbors.push_back(CPU_Neighbor(dist, probes[j]));
-			}
-		}
+		vector<Kd_Neighbor> neighbors;
+		probe_tree.nearest(probes.position[index], neighbor_count + 1, neighbors, index);
 
-		sort(neighbors.begin(), neighbors.end(), [](const CPU_Neighbor& a, const CPU_Neighbor& b) {
-			return a.distance < b.distance;
-		});
+		if (neighbors.empty()) return;
 
-		probe->smoothing_radius = neighbors[NUM_NEIGHBORS].distance * 1.25;
-		for (uint k = 0; k < NUM_NEIGHBORS; k++) {
-			probe->neighbors.push_back(neighbors[k]);
+		probes.smoothing_radius[index] = neighbors.back().distance * 1.25;
+		for (uint k = 0; k < neighbor_count; k++) {
+			probes.neighbor_index[offset + k] = neighbors[k].index;
+			probes.neighbor_distance[offset + k] = neighbors[k].distance;
+			probes.neighbor_direction[offset + k] = (probes.position[neighbors[k].index] - probes.position[index]) / neighbors[k].distance;
 		}
-
-		for (CPU_Neighbor& neighbor : probe->neighbors) {
-			const dvec1 smoothing_kernel = pow(glm::max(0.0, probe->smoothing_radius - neighbor.distance), 3.0);
-
-			const dvec3 direction = neighbor.probe->data.position - probe->data.position;
-
-			const dvec3 unitDirection = direction / neighbor.distance;
-			const dvec1 pressureDifference = (probe->data.pressure - neighbor.probe->data.pressure) * 10.0;
-			probe->data.wind_vector += unitDirection * (pressureDifference) * smoothing_kernel * 10.0;
+	});
+
+	// Kernel weights need the smoothing radius of both ends, distances are fixed in the body frame so they are computed once
+	f_parallelFor(0, probes.size(), [&](const uint& index) {
+		for (uint edge = probes.neighbor_offsets[index]; edge < probes.neighbor_offsets[index + 1]; edge++) {
+			const uint  neighbor = probes.neighbor_index[edge];
+			const dvec1 distance = probes.neighbor_distance[edge];
+			const dvec1 weight = glm::max(0.0, probes.smoothing_radius[index] - distance);
+			const dvec1 inverse_weight = glm::max(0.0, probes.smoothing_radius[neighbor] - distance);
+			probes.neighbor_weight[edge] = weight * weight * weight;
+			probes.neighbor_inverse_weight[edge] = inverse_weight * inverse_weight * inverse_weight;
+
+			const dvec1 pressureDifference = (data.pressure[index] - data.pressure[neighbor]) * 10.0;
+			data.wind_vector[index] += probes.neighbor_direction[edge] * (pressureDifference) * probes.neighbor_weight[edge] * 10.0;
 		}
+	});
 
-		//if ((i % (PROBE_COUNT / 5)) == 0) {
-		//	#pragma omp critical
-		//	cout << "Lock Probes: " << f_to_u(round(u_to_f(i) / u_to_f(PROBE_COUNT) * 100.0f)) << "%" << endl;
-		//}
+	// Uniform BVH padding for the SPH display modes
+	max_smoothing_radius = 0.0f;
+	for (uint index = 0; index < probes.size(); index++) {
+		max_smoothing_radius = max(max_smoothing_radius, d_to_f(probes.smoothing_radius[index]));
 	}
 }
 
 void Kernel::lockParticles() {
-	int i = 0;
-	int i_size = u_to_i(PARTICLE_COUNT);
-	#pragma omp parallel for private(i) num_threads(12)
-	for (i = 0; i < i_size; i++) {
+	if (probes.size() == 0) {
+		return;
+	}
+	f_parallelFor(0, len32(particles), [&](const uint& i) {
 		CPU_Particle* particle = particles[i];
 
-		vector<CPU_Neighbor> neighbors;
-
-		for (uint j = 0; j < PROBE_COUNT; j++) {
-			if (i != j) {
-				const dvec1 dist = glm::distance(particle->transformed_position, probes[j]->transformed_position);
-				neighbors.push_back(CPU_Neighbor(dist, probes[j]));
-			}
-		}
-
-		sort(neighbors.begin(), neighbors.end(), [](const CPU_Neighbor& a, const CPU_Neighbor& b) {
-			return a.distance < b.distance;
-		});
-
-		particle->probe = neighbors[0].probe;
+		// Probes and particles share the Earth rotation, so the closest probe can be found in the body frame
+		particle->probe = closestProbe(particle->rotation * particle->position);
+	});
+}
 
-		//if ((i % (PROBE_COUNT / 5)) == 0) {
-		//	#pragma omp critical
-		//	cout << "Lock Particles: " << f_to_u(round(u_to_f(i) / u_to_f(PROBE_COUNT) * 100.0f)) << "%" << endl;
-		//}
+uint Kernel::closestProbe(const dvec3& position) const {
+	if (PROBE_POLE_BIAS == 0.0) {
+		const dvec3 lattice_position = glm::inverse(rotateGeoloc(PROBE_POLE_GEOLOCATION)) * position;
+		return f_inverseFibonacci(glm::normalize(lattice_position), probes.size());
 	}
+	return probe_tree.closest(position).index;
 }
 
-
 void Kernel::simulate(const dvec1& delta_time) {
 	DT = clamp(delta_time, 0.0, 0.25) * TIME_SCALE;
-	SDT = DT / u_to_d(SUB_SAMPLES);
-	RESET_TIMER("Scatter");
-	RESET_TIMER("Gather");
+	controlSubsteps();
 
 	const dvec1 day_time = DAY_TIME * 24.0;
 	CALENDAR_HOUR = int(round(day_time - glm::fract(day_time)));
 	CALENDAR_MINUTE = int(round(glm::fract(day_time) * 60.0));
-	for (uint i = 0; i < SUB_SAMPLES; i++) {
+	for (uint i = 0; i < step_control.sub_samples; i++) {
 		updateTime();
 		sun_dir = sunDir();
-		for (CPU_Probe* probe : probes) {
-			probe->new_data = probe->data;
-		}
+		earth_rotation = earthRotation();
 
 		// SCATTER
-		START_TIMER("Scatter");
-		for (CPU_Probe* probe : probes) {
-			updateProbePosition(probe);
-			calculateSunlight(probe);
-			scatterSPH(probe);
-		}
-		ADD_TIMER("Scatter");
+		const auto scatter_time = chrono::high_resolution_clock::now();
+		scatterProbes(probes);
+		timings.scatter += f_elapsed(scatter_time);
 
 		// GATHER
-		START_TIMER("Gather");
-		for (CPU_Probe* probe : probes) {
-			gatherWind(probe);
-			gatherThermodynamics(probe);
-
-			probe->data = probe->new_data;
+		const auto gather_time = chrono::high_resolution_clock::now();
+		gatherProbes(probes);
+		probes.swap();
+		timings.gather += f_elapsed(gather_time);
+
+		// Same substep inputs, so the divergence is the precision alone
+		if (COMPARE_PRECISION) {
+			scatterProbes(probes_fp32);
+			gatherProbes(probes_fp32);
+			probes_fp32.swap();
+			precision_report.substeps++;
 		}
-		ADD_TIMER("Gather");
+		substep++;
+	}
+	if (COMPARE_PRECISION) {
+		comparePrecision();
 	}
 
-	START_TIMER("Particle Update");
-	int i = 0;
-	int i_size = ul_to_i(particles.size());
-	//#pragma omp parallel for private(i) num_threads(12)
-	for (i = 0;  i < i_size; i++) {
+	const auto update_time = chrono::high_resolution_clock::now();
+	f_parallelFor(0, len32(particles), [&](const uint& i) {
 		updateParticlePosition(particles[i]);
 		calculateParticle(particles[i]);
 		updateParticlePosition(particles[i]);
-	}
-	END_TIMER("Particle Update");
+	});
+	timings.particle_update += f_elapsed(update_time);
 
 	updateGPUParticles();
-	updateGPUProbes();
+	updateGPUProbeStates();
+}
+
+// CFL style limits on the fp64 state at the start of the step: wind may not carry a field past the nearest neighbor,
+// the thermal relaxation must stay monotone and no probe may heat or cool by more than MAX_SUBSTEP_HEATING per substep.
+// Large time scales take as many substeps as the fastest probe needs, quiet states take one.
+void Kernel::controlSubsteps() {
+	const Probe_State& data = probes.current();
+	const uint batches = (probes.size() + PROBE_BATCH - 1) / PROBE_BATCH;
+	vector<dvec3> batch_rates(batches, dvec3(0.0)); // Advection, relaxation, heating
+	f_parallelFor(0, batches, [&](const uint& j) {
+		const uint start = j * PROBE_BATCH;
+		const uint end = min(start + PROBE_BATCH, probes.size());
+		dvec3 rates = dvec3(0.0);
+		for (uint index = start; index < end; index++) {
+			const uint neighbor_count = probes.neighborCount(index);
+			const dvec1 temperature = data.temperature[index];
+			dvec1 sph_temperature = temperature;
+			if (neighbor_count > 0) {
+				// Neighbors are sorted by distance, the first edge is the nearest
+				const dvec1 spacing = max(probes.neighbor_distance[probes.neighbor_offsets[index]], 1e-9);
+				rates.x = max(rates.x, glm::length(data.wind_vector[index]) * WIND_TO_BODY / spacing);
+				for (uint edge = probes.neighbor_offsets[index]; edge < probes.neighbor_offsets[index + 1]; edge++) {
+					sph_temperature += data.temperature[probes.neighbor_index[edge]];
+				}
+				sph_temperature /= u_to_d(neighbor_count + 1);
+			}
+
+			// Same terms as gatherThermodynamics, the probe itself is 1 / (n + 1) of its SPH temperature
+			const dvec1 radiative = probes.emissivity[index] * STEFAN_BOLZMANN * temperature * temperature * temperature;
+			const dvec1 coefficient = probes.convection_coefficient[index];
+			const dvec1 net_heat = ((1.0 - probes.albedo[index]) * data.solar_irradiance[index] * 0.001 - radiative * temperature * 0.005 - coefficient * (temperature - sph_temperature) * 0.001) * probes.surface_area[index];
+			const dvec1 relaxation = (4.0 * radiative * 0.005 + coefficient * 0.001 * u_to_d(neighbor_count) / u_to_d(neighbor_count + 1)) * probes.surface_area[index];
+			rates.y = max(rates.y, relaxation);
+			rates.z = max(rates.z, abs(net_heat));
+		}
+		batch_rates[j] = rates;
+	});
+
+	step_control = Step_Control();
+	for (const dvec3& rates : batch_rates) {
+		step_control.advection = max(step_control.advection, rates.x);
+		step_control.relaxation = max(step_control.relaxation, rates.y);
+		step_control.heating = max(step_control.heating, rates.z);
+	}
+	const dvec1 rate = max(max(step_control.advection, step_control.relaxation) / COURANT, step_control.heating / MAX_SUBSTEP_HEATING);
+	step_control.stable_dt = rate > 0.0 ? 1.0 / rate : MAX_DVEC1;
+	const dvec1 needed = ceil(DT * rate);
+	step_control.capped = needed > u_to_d(MAX_SUB_SAMPLES);
+	step_control.sub_samples = step_control.capped ? MAX_SUB_SAMPLES : max(1U, d_to_u(needed));
+	SDT = DT / u_to_d(step_control.sub_samples);
 }
 
 void Kernel::updateTime() {
@@ -318,103 +688,115 @@ void Kernel::updateTime() {
 	}
 }
 
-void Kernel::updateProbePosition(CPU_Probe* probe) const {
-	const dvec1 axialTilt = -glm::radians(EARTH_TILT);
-	const dvec1 theta = glm::radians(DAY_TIME * 360.0);
+// Each stage reads the current state and neighbors, and only writes the next state / sph_ fields of its own probe
+template <typename T>
+void Kernel::scatterProbes(Probe_Store_T<T>& store) {
+	f_parallelFor(0, (store.size() + PROBE_BATCH - 1) / PROBE_BATCH, [&](const uint& j) {
+		const uint start = j * PROBE_BATCH;
+		const uint end = min(start + PROBE_BATCH, store.size());
+		for (uint index = start; index < end; index++) {
+			updateProbePosition(store, index);
+			scatterSPH(store, index);
+		}
+		calculateSunlight(store, start, end);
+	});
+}
 
-	const dquat tiltRotation = glm::angleAxis(axialTilt, dvec3(0, 0, 1));
-	const dquat timeRotation = glm::angleAxis(theta, dvec3(0, 1, 0));
-	const dquat combinedRotation = tiltRotation * timeRotation;
+template <typename T>
+void Kernel::gatherProbes(Probe_Store_T<T>& store) {
+	f_parallelFor(0, (store.size() + PROBE_BATCH - 1) / PROBE_BATCH, [&](const uint& j) {
+		const uint start = j * PROBE_BATCH;
+		const uint end = min(start + PROBE_BATCH, store.size());
+		for (uint index = start; index < end; index++) {
+			gatherWind(store, index);
+		}
+		gatherThermodynamics(store, start, end);
+	});
+}
 
-	probe->transformed_position = combinedRotation * probe->data.position;
+template <typename T>
+void Kernel::updateProbePosition(Probe_Store_T<T>& store, const uint& index) {
+	store.transformed_position[index] = tvec3<T>(earth_rotation * dvec3(store.position[index]));
 }
 
-void Kernel::scatterSPH(CPU_Probe* probe) const {
-	probe->sph = CPU_Probe_Data();
-	if (probe->neighbors.size() > 0) {
-		for (CPU_Neighbor& neighbor : probe->neighbors) {
-			const dvec1 smoothing_kernel = pow(glm::max(0.0, probe->smoothing_radius - neighbor.distance), 3.0);
-			probe->sph.temperature += neighbor.probe->data.temperature;
+template <typename T>
+void Kernel::scatterSPH(Probe_Store_T<T>& store, const uint& index) {
+	const Probe_State_T<T>& data = store.current();
+	const uint neighbor_count = store.neighborCount(index);
+	if (neighbor_count > 0) {
+		T temperature = T(0);
+		for (uint edge = store.neighbor_offsets[index]; edge < store.neighbor_offsets[index + 1]; edge++) {
+			temperature += data.temperature[store.neighbor_index[edge]];
 		}
-		probe->sph.temperature += probe->data.temperature;
-		probe->sph.temperature /= ul_to_d(probe->neighbors.size() + 1);
-		scatterWind(probe);
+		temperature += data.temperature[index];
+		store.sph_temperature[index] = temperature / static_cast<T>(neighbor_count + 1);
+		store.sph_pressure[index] = T(0);
+		scatterWind(store, index);
 	}
 	else {
-		probe->sph = probe->data;
+		store.sph_temperature[index] = data.temperature[index];
+		store.sph_pressure[index] = data.pressure[index];
+		store.sph_wind_vector[index] = data.wind_vector[index];
 	}
 }
 
-void Kernel::scatterWind(CPU_Probe* probe) const {
-	dvec3 wind = dvec3(0);
-	dvec3 pressure_gradient = dvec3(0);
-
-	for (CPU_Neighbor& neighbor : probe->neighbors) {
-		const dvec1 smoothing_kernel = pow(glm::max(0.0, probe->smoothing_radius - neighbor.distance), 3.0);
+template <typename T>
+void Kernel::scatterWind(Probe_Store_T<T>& store, const uint& index) {
+	const Probe_State_T<T>& data = store.current();
+	tvec3<T> wind = tvec3<T>(0);
+	tvec3<T> pressure_gradient = tvec3<T>(0);
 
-		const dvec3 direction = neighbor.probe->data.position - probe->data.position;
+	for (uint edge = store.neighbor_offsets[index]; edge < store.neighbor_offsets[index + 1]; edge++) {
+		const uint neighbor = store.neighbor_index[edge];
+		const T    smoothing_kernel = store.neighbor_weight[edge];
 
-		const dvec3 unitDirection = direction / neighbor.distance;
-		const dvec1 pressureDifference = (probe->data.pressure - neighbor.probe->data.pressure) * 10.0;
-		pressure_gradient += unitDirection * (pressureDifference) * smoothing_kernel;
-		wind += neighbor.probe->data.wind_vector * smoothing_kernel;
+		const T pressureDifference = (data.pressure[index] - data.pressure[neighbor]) * T(10);
+		pressure_gradient += store.neighbor_direction[edge] * (pressureDifference) * smoothing_kernel;
+		wind += data.wind_vector[neighbor] * smoothing_kernel;
 	}
 
-	wind /= ul_to_d(probe->neighbors.size());
-	pressure_gradient /= ul_to_d(probe->neighbors.size());
-	probe->sph.wind_vector = wind + pressure_gradient;
+	wind /= static_cast<T>(store.neighborCount(index));
+	pressure_gradient /= static_cast<T>(store.neighborCount(index));
+	store.sph_wind_vector[index] = wind + pressure_gradient;
 }
 
-void Kernel::traceInitProperties(CPU_Probe* probe) const {
-	const dvec3 ray_direction = glm::normalize(dvec3(0) - probe->transformed_position);
-
-	const dvec1 a = glm::dot(ray_direction, ray_direction);
-	const dvec1 b = 2.0 * dot(ray_direction, probe->transformed_position);
-	const dvec1 c = dot(probe->transformed_position, probe->transformed_position) - 40.589641; // Earth Radius ^2
-	const dvec1 delta = b * b - 4.0 * a * c;
-	if (delta < 0.0) {
-		return;
-	}
-
-	const dvec3 intersectionPoint = probe->transformed_position + ((-b - sqrt(delta)) / (2.0 * a)) * ray_direction;
-	const dvec1 axialTilt = -glm::radians(EARTH_TILT);
-	const dmat3 tiltRotation = dmat3(
-		dvec3(cos(axialTilt), -sin(axialTilt), 0),
-		dvec3(sin(axialTilt), cos(axialTilt), 0),
-		dvec3(0, 0, 1));
-
-
-	const dvec3 normal = tiltRotation * glm::normalize(intersectionPoint);
-
-	const dvec1 theta = acos(normal.y);
-	const dvec1 phi = glm::atan(normal.z, normal.x);
-
-	const dvec2 uv = dvec2(glm::fract(1.0 - ((phi + PI) / TWO_PI) - DAY_TIME), (theta) / PI);
-
-	const vec1 topography_sample = textures.at(Texture_Field::TOPOGRAPHY                    ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 bathymetry_sample = textures.at(Texture_Field::BATHYMETRY                    ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 pressure_sample   = textures.at(Texture_Field::SURFACE_PRESSURE              ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 sst_sample        = textures.at(Texture_Field::SEA_SURFACE_TEMPERATURE_DAY   ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 sst_night_sample  = textures.at(Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 lst_sample        = textures.at(Texture_Field::LAND_SURFACE_TEMPERATURE_DAY  ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 lst_night_sample  = textures.at(Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-
-	const vec1 humidity_sample                = textures.at(Texture_Field::HUMIDITY                  ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 water_vapor_sample             = textures.at(Texture_Field::WATER_VAPOR               ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 cloud_coverage_sample          = textures.at(Texture_Field::CLOUD_COVERAGE            ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 cloud_water_content_sample     = textures.at(Texture_Field::CLOUD_WATER_CONTENT       ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 cloud_particle_radius_sample   = textures.at(Texture_Field::CLOUD_PARTICLE_RADIUS     ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 cloud_optical_thickness_sample = textures.at(Texture_Field::CLOUD_OPTICAL_THICKNESS   ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-
-	const vec1 ozone_sample                         = textures.at(Texture_Field::OZONE                        ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 albedo_sample                        = textures.at(Texture_Field::ALBEDO                       ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 uv_index_sample                      = textures.at(Texture_Field::UV_INDEX                     ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 net_radiation_sample                 = textures.at(Texture_Field::NET_RADIATION                ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 solar_insolation_sample              = textures.at(Texture_Field::SOLAR_INSOLATION             ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 outgoiing_longwave_radiation_sample  = textures.at(Texture_Field::OUTGOING_LONGWAVE_RADIATION  ).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
-	const vec1 reflected_shortwave_radiation_sample = textures.at(Texture_Field::REFLECTED_SHORTWAVE_RADIATION).sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
+void Kernel::sampleProbes() {
+	f_parallelFor(0, probes.size(), [&](const uint& i) {
+		traceInitProperties(i);
+	});
+}
 
-	const vec4 wind_vector_sample = textures.at(Texture_Field::WIND_VECTOR).sampleTexture(uv, Texture_Format::RGBA_8);
+void Kernel::traceInitProperties(const uint& index) {
+	Probe_State& data = probes.current();
+	const vec2 uv = probes.uv[index];
+	const auto sample = [&](const Texture_Field& field) {
+		return texture_fields[static_cast<uint64>(field)]->sampleTextureMono(uv, Texture_Format::MONO_FLOAT);
+	};
+
+	const vec1 topography_sample = sample(Texture_Field::TOPOGRAPHY                    );
+	const vec1 bathymetry_sample = sample(Texture_Field::BATHYMETRY                    );
+	const vec1 pressure_sample   = sample(Texture_Field::SURFACE_PRESSURE              );
+	const vec1 sst_sample        = sample(Texture_Field::SEA_SURFACE_TEMPERATURE_DAY   );
+	const vec1 sst_night_sample  = sample(Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT );
+	const vec1 lst_sample        = sample(Texture_Field::LAND_SURFACE_TEMPERATURE_DAY  );
+	const vec1 lst_night_sample  = sample(Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT);
+
+	const vec1 humidity_sample                = sample(Texture_Field::HUMIDITY                  );
+	const vec1 water_vapor_sample             = sample(Texture_Field::WATER_VAPOR               );
+	const vec1 cloud_coverage_sample          = sample(Texture_Field::CLOUD_COVERAGE            );
+	const vec1 cloud_water_content_sample     = sample(Texture_Field::CLOUD_WATER_CONTENT       );
+	const vec1 cloud_particle_radius_sample   = sample(Texture_Field::CLOUD_PARTICLE_RADIUS     );
+	const vec1 cloud_optical_thickness_sample = sample(Texture_Field::CLOUD_OPTICAL_THICKNESS   );
+
+	const vec1 ozone_sample                         = sample(Texture_Field::OZONE                        );
+	const vec1 albedo_sample                        = sample(Texture_Field::ALBEDO                       );
+	const vec1 uv_index_sample                      = sample(Texture_Field::UV_INDEX                     );
+	const vec1 net_radiation_sample                 = sample(Texture_Field::NET_RADIATION                );
+	const vec1 solar_insolation_sample              = sample(Texture_Field::SOLAR_INSOLATION             );
+	const vec1 outgoiing_longwave_radiation_sample  = sample(Texture_Field::OUTGOING_LONGWAVE_RADIATION  );
+	const vec1 reflected_shortwave_radiation_sample = sample(Texture_Field::REFLECTED_SHORTWAVE_RADIATION);
+
+	const vec4 wind_vector_sample = texture_fields[static_cast<uint64>(Texture_Field::WIND_VECTOR)]->sampleTexture(uv, Texture_Format::RGBA_8);
 
 	{
 		const vec1 topography = lut(Texture_Field::TOPOGRAPHY, topography_sample);
@@ -423,106 +805,181 @@ void Kernel::traceInitProperties(CPU_Probe* probe) const {
 		const vec1 sst_night = lut(Texture_Field::SEA_SURFACE_TEMPERATURE_NIGHT, sst_night_sample);
 		const vec1 lst = lut(Texture_Field::LAND_SURFACE_TEMPERATURE_DAY, lst_sample);
 		const vec1 lst_night = lut(Texture_Field::LAND_SURFACE_TEMPERATURE_NIGHT, lst_night_sample);
-		probe->data.pressure = lut(Texture_Field::SURFACE_PRESSURE, pressure_sample);
+		data.pressure[index] = lut(Texture_Field::SURFACE_PRESSURE, pressure_sample);
 
 		if (topography == -1.0) { // Is at sea
-			probe->data.day_temperature = sst;
-			probe->data.night_temperature = sst_night;
-			probe->data.on_water = true;
-			probe->data.height = bathymetry;
-			probe->data.albedo = 0.135;
+			probes.day_temperature[index] = sst;
+			probes.night_temperature[index] = sst_night;
+			probes.on_water[index] = true;
+			probes.height[index] = bathymetry;
+			probes.albedo[index] = 0.135;
 		}
 		else { // Is on Land
-			probe->data.day_temperature = lst;
-			probe->data.night_temperature = lst_night;
-			probe->data.on_water = false;
-			probe->data.height = topography;
-			probe->data.albedo = lut(Texture_Field::ALBEDO, albedo_sample);
+			probes.day_temperature[index] = lst;
+			probes.night_temperature[index] = lst_night;
+			probes.on_water[index] = false;
+			probes.height[index] = topography;
+			probes.albedo[index] = lut(Texture_Field::ALBEDO, albedo_sample);
 		}
-		probe->data.temperature = glm::mix(probe->data.night_temperature, probe->data.day_temperature, probe->data.sun_intensity);
-
-		probe->data.humidity = lut(Texture_Field::HUMIDITY, humidity_sample);
-		probe->data.water_vapor = lut(Texture_Field::WATER_VAPOR, water_vapor_sample);
-		probe->data.cloud_coverage = lut(Texture_Field::CLOUD_COVERAGE, cloud_coverage_sample);
-		probe->data.cloud_water_content = lut(Texture_Field::CLOUD_WATER_CONTENT, cloud_water_content_sample);
-		probe->data.cloud_particle_radius = lut(Texture_Field::CLOUD_PARTICLE_RADIUS, cloud_particle_radius_sample);
-		probe->data.cloud_optical_thickness = lut(Texture_Field::CLOUD_OPTICAL_THICKNESS, cloud_optical_thickness_sample);
-
-		probe->data.ozone = lut(Texture_Field::OZONE, ozone_sample);
-		probe->data.uv_index = lut(Texture_Field::UV_INDEX, uv_index_sample);
-		probe->data.net_radiation = lut(Texture_Field::NET_RADIATION, net_radiation_sample);
-		probe->data.solar_insolation = lut(Texture_Field::SOLAR_INSOLATION, solar_insolation_sample);
-		probe->data.outgoing_longwave_radiation = lut(Texture_Field::OUTGOING_LONGWAVE_RADIATION, outgoiing_longwave_radiation_sample);
-		probe->data.reflected_shortwave_radiation = lut(Texture_Field::REFLECTED_SHORTWAVE_RADIATION, reflected_shortwave_radiation_sample);
-		calculateSunlight(probe);
-		probe->data.sun_intensity = probe->new_data.sun_intensity;
-		probe->data.solar_irradiance = probe->new_data.solar_irradiance;
-		probe->data.emissivity = clamp(probe->data.reflected_shortwave_radiation / (1360.0 - probe->data.solar_insolation), 0.0, 1.0);
-
-		const dvec1 axialTilt = -glm::radians(EARTH_TILT);
-		const dvec1 u = glm::radians(wind_vector_sample.x);
-		const dvec1 v = glm::radians(wind_vector_sample.y);
-
-		const dquat tiltRotation = glm::angleAxis(axialTilt, dvec3(0, 0, 1));
-		const dquat uRotation  = glm::angleAxis(u,dvec3(0, 1, 0));
-		const dquat vRotation  = glm::angleAxis(v, dvec3(1, 0, 0));
-
-		probe->data.wind_quaternion = tiltRotation * uRotation * vRotation;
-		probe->data.wind_u = wind_vector_sample.x;
-		probe->data.wind_v = wind_vector_sample.y;
+		data.temperature[index] = glm::mix(probes.night_temperature[index], probes.day_temperature[index], data.sun_intensity[index]);
+
+		probes.humidity[index] = lut(Texture_Field::HUMIDITY, humidity_sample);
+		probes.water_vapor[index] = lut(Texture_Field::WATER_VAPOR, water_vapor_sample);
+		probes.cloud_coverage[index] = lut(Texture_Field::CLOUD_COVERAGE, cloud_coverage_sample);
+		probes.cloud_water_content[index] = lut(Texture_Field::CLOUD_WATER_CONTENT, cloud_water_content_sample);
+		probes.cloud_particle_radius[index] = lut(Texture_Field::CLOUD_PARTICLE_RADIUS, cloud_particle_radius_sample);
+		probes.cloud_optical_thickness[index] = lut(Texture_Field::CLOUD_OPTICAL_THICKNESS, cloud_optical_thickness_sample);
+
+		probes.ozone[index] = lut(Texture_Field::OZONE, ozone_sample);
+		probes.uv_index[index] = lut(Texture_Field::UV_INDEX, uv_index_sample);
+		probes.net_radiation[index] = lut(Texture_Field::NET_RADIATION, net_radiation_sample);
+		probes.solar_insolation[index] = lut(Texture_Field::SOLAR_INSOLATION, solar_insolation_sample);
+		probes.outgoing_longwave_radiation[index] = lut(Texture_Field::OUTGOING_LONGWAVE_RADIATION, outgoiing_longwave_radiation_sample);
+		probes.reflected_shortwave_radiation[index] = lut(Texture_Field::REFLECTED_SHORTWAVE_RADIATION, reflected_shortwave_radiation_sample);
+		calculateSunlight(probes, index, index + 1);
+		data.sun_intensity[index] = probes.next().sun_intensity[index];
+		data.solar_irradiance[index] = probes.next().solar_irradiance[index];
+		probes.emissivity[index] = clamp(probes.reflected_shortwave_radiation[index] / (1360.0 - probes.solar_insolation[index]), 0.0, 1.0);
+
+		probes.wind_u[index] = wind_vector_sample.x;
+		probes.wind_v[index] = wind_vector_sample.y;
+		probes.wind_quaternion[index] = windRotation(probes.wind_u[index], probes.wind_v[index]);
+		probes.convection_coefficient[index] = pow(1.0 + glm::length(dvec2(wind_vector_sample.x, wind_vector_sample.y)), 0.35);
 	}
 }
 
-void Kernel::calculateSunlight(CPU_Probe* probe) const {
-	const dvec3 normal = glm::normalize(probe->transformed_position);
-	probe->new_data.sun_intensity = clamp(dot(normal, sun_dir), 0.0, 1.0); // %
-	probe->new_data.solar_irradiance = max((probe->data.sun_intensity * 1360.0) - probe->data.solar_insolation, 0.0); // W/m^2
+template <typename T>
+void Kernel::calculateSunlight(Probe_Store_T<T>& store, const uint& start, const uint& end) {
+	const tvec3<T> sun = tvec3<T>(sun_dir);
+	const tvec3<T>* position    = store.transformed_position.data();
+	const T* solar_insolation   = store.solar_insolation.data();
+	const T* sun_intensity      = store.current().sun_intensity.data();
+	T* new_sun_intensity        = store.next().sun_intensity.data();
+	T* new_solar_irradiance     = store.next().solar_irradiance.data();
+
+	for (uint index = start; index < end; index++) {
+		const tvec3<T> normal = position[index] / glm::length(position[index]);
+		new_sun_intensity[index] = glm::clamp(glm::dot(normal, sun), T(0), T(1)); // %
+		new_solar_irradiance[index] = glm::max((sun_intensity[index] * T(1360)) - solar_insolation[index], T(0)); // W/m^2
+	}
 }
 
-void Kernel::gatherWind(CPU_Probe* probe) const {
-	dvec3 wind = dvec3(0);
-	for (CPU_Neighbor& neighbor : probe->neighbors) {
-		const dvec1 inv_smoothing_kernel = pow(glm::max(0.0, neighbor.probe->smoothing_radius - neighbor.distance), 3.0);
-
-		wind += neighbor.probe->sph.wind_vector * inv_smoothing_kernel * 1.5;
+template <typename T>
+void Kernel::gatherWind(Probe_Store_T<T>& store, const uint& index) {
+	tvec3<T> wind = tvec3<T>(0);
+	for (uint edge = store.neighbor_offsets[index]; edge < store.neighbor_offsets[index + 1]; edge++) {
+		wind += store.sph_wind_vector[store.neighbor_index[edge]] * store.neighbor_inverse_weight[edge] * T(1.5);
 	}
-	wind /= ul_to_d(probe->neighbors.size());
-	probe->new_data.wind_vector *= (1.0 - SDT * 0.01);
-	probe->new_data.wind_vector += (wind * SDT) * 2.5;
-	//probe->new_data.wind_vector = glm::rotate(glm::angleAxis(glm::linearRand(-0.01, 0.01), glm::normalize(probe->transformed_position)), probe->new_data.wind_vector);
+	if (store.neighborCount(index) > 0) {
+		wind /= static_cast<T>(store.neighborCount(index));
+	}
+	tvec3<T>& wind_vector = store.next().wind_vector[index];
+	wind_vector = store.current().wind_vector[index] * static_cast<T>(1.0 - SDT * 0.01);
+	wind_vector += (wind * static_cast<T>(SDT)) * T(2.5);
+	//wind_vector = glm::rotate(glm::angleAxis(glm::linearRand(-0.01, 0.01), glm::normalize(probes.transformed_position[index])), wind_vector);
 	// TODO implement coriolis
-	const dvec1 wind_speed = glm::length(probe->new_data.wind_vector);
-	if (wind_speed == 0.0) {
-		probe->new_data.wind_vector = glm::normalize(dvec3(randD(1.0, 2.0), randD(1.0, 2.0), randD(1.0, 2.0)));
+	const T wind_speed = glm::length(wind_vector);
+	if (wind_speed == T(0)) {
+		wind_vector = tvec3<T>(glm::normalize(dvec3(1.0) + dvec3(f_randD(SEED, index, substep, RNG_PROBE_WIND), f_randD(SEED, index, substep, RNG_PROBE_WIND + 1), f_randD(SEED, index, substep, RNG_PROBE_WIND + 2))));
 	}
-	if (wind_speed < 0.005) {
-		probe->new_data.wind_vector	= glm::normalize(probe->new_data.wind_vector) * 0.1;
+	if (wind_speed < T(0.005)) {
+		wind_vector	= glm::normalize(wind_vector) * T(0.1);
 		//cout << "Wind Too Slow: " << wind_speed << endl;
 	}
-	if (wind_speed > 40.0) {
-		probe->new_data.wind_vector = glm::normalize(probe->new_data.wind_vector) * 35.0;
+	if (wind_speed > T(40)) {
+		wind_vector = glm::normalize(wind_vector) * T(35);
 		//cout << "Wind Too Fast: " << wind_speed << endl;
 	}
 }
 
-void Kernel::gatherThermodynamics(CPU_Probe* probe) const {
-	// = solar_heat_transfer_coefficient * (absorptivity) * (solar irradiance) * area
-	const dvec1 solar_heat_absorption = (1.0 - probe->data.albedo) * probe->data.solar_irradiance * probe->data.surface_area;
+template <typename T>
+void Kernel::gatherThermodynamics(Probe_Store_T<T>& store, const uint& start, const uint& end) {
+	const Probe_State_T<T>& data = store.current();
+	Probe_State_T<T>& new_data = store.next();
+
+	// Reference path: per substep pow, used to validate the batched path
+	if (EXACT_THERMODYNAMICS) {
+		for (uint index = start; index < end; index++) {
+			const dvec1 surface_area = store.surface_area[index];
+			const dvec1 temperature = data.temperature[index];
 
-	// = emissivity * Stefan-Boltzmann * temperature * area
-	const dvec1 radiative_loss = probe->data.emissivity * STEFAN_BOLZMANN * pow(probe->data.temperature, 4.0) * probe->data.surface_area;
+			// = solar_heat_transfer_coefficient * (absorptivity) * (solar irradiance) * area
+			const dvec1 solar_heat_absorption = (1.0 - store.albedo[index]) * data.solar_irradiance[index] * surface_area;
 
-	// = (convective_heat_transfer_coefficient) * (temperature - surrounding_temperature) * area
-	const dvec1 wind_speed = glm::length(vec2(probe->data.wind_u, probe->data.wind_v));
-	const dvec1 coeff = pow((1.0 + wind_speed), 0.35);
-	const dvec1 convective_transfer = coeff * (probe->data.temperature - probe->sph.temperature) * probe->data.surface_area;
+			// = emissivity * Stefan-Boltzmann * temperature * area
+			const dvec1 radiative_loss = store.emissivity[index] * STEFAN_BOLZMANN * pow(temperature, 4.0) * surface_area;
 
-	const dvec1 net_heat = solar_heat_absorption * 0.001 - radiative_loss * 0.005 - convective_transfer * 0.001;
-	if (abs(net_heat) > 1.0) {
-		cout << "Temp Changing Too Quickly: Net  " << net_heat << "  | Solar  " << solar_heat_absorption << "  | Rad  -" << radiative_loss << "  | Convection  " << convective_transfer << endl;
+			// = (convective_heat_transfer_coefficient) * (temperature - surrounding_temperature) * area
+			const dvec1 wind_speed = glm::length(dvec2(store.wind_u[index], store.wind_v[index]));
+			const dvec1 coeff = pow((1.0 + wind_speed), 0.35);
+			const dvec1 convective_transfer = coeff * (temperature - store.sph_temperature[index]) * surface_area;
+
+			const dvec1 net_heat = solar_heat_absorption * 0.001 - radiative_loss * 0.005 - convective_transfer * 0.001;
+			new_data.temperature[index] = static_cast<T>(temperature + net_heat * SDT);
+			new_data.pressure[index] = static_cast<T>(data.pressure[index] + net_heat * SDT);
+		}
+		return;
+	}
+
+	// Branch free over contiguous fields, T^4 by two squares and the convection coefficient sampled once
+	const T sdt = static_cast<T>(SDT);
+	const T stefan_boltzmann = static_cast<T>(STEFAN_BOLZMANN);
+	const T* surface_area     = store.surface_area.data();
+	const T* albedo           = store.albedo.data();
+	const T* emissivity       = store.emissivity.data();
+	const T* coefficient      = store.convection_coefficient.data();
+	const T* sph_temperature  = store.sph_temperature.data();
+	const T* temperature      = data.temperature.data();
+	const T* pressure         = data.pressure.data();
+	const T* solar_irradiance = data.solar_irradiance.data();
+	T* new_temperature = new_data.temperature.data();
+	T* new_pressure    = new_data.pressure.data();
+
+	for (uint index = start; index < end; index++) {
+		const T temperature_2 = temperature[index] * temperature[index];
+		const T solar_heat_absorption = (T(1) - albedo[index]) * solar_irradiance[index];
+		const T radiative_loss = emissivity[index] * stefan_boltzmann * (temperature_2 * temperature_2);
+		const T convective_transfer = coefficient[index] * (temperature[index] - sph_temperature[index]);
+
+		const T net_heat = (solar_heat_absorption * T(0.001) - radiative_loss * T(0.005) - convective_transfer * T(0.001)) * surface_area[index];
+		new_temperature[index] = temperature[index] + net_heat * sdt;
+		new_pressure[index] = pressure[index] + net_heat * sdt;
 	}
-	probe->new_data.temperature += net_heat * SDT;
-	probe->new_data.pressure += net_heat * SDT;
+}
+
+void Kernel::resetComparison() {
+	precision_report = Precision_Report();
+	if (COMPARE_PRECISION) {
+		probes_fp32.convert(probes);
+	}
+}
+
+void Kernel::comparePrecision() {
+	if (probes_fp32.size() != probes.size()) {
+		resetComparison();
+		return;
+	}
+	const Probe_State& data = probes.current();
+	const Probe_State_T<vec1>& data_fp32 = probes_fp32.current();
+	dvec1 temperature = 0.0;
+	dvec1 pressure = 0.0;
+	dvec1 wind = 0.0;
+	dvec1 relative = 0.0;
+	for (uint index = 0; index < probes.size(); index++) {
+		const dvec1 temperature_error = abs(data.temperature[index] - f_to_d(data_fp32.temperature[index]));
+		const dvec1 pressure_error = abs(data.pressure[index] - f_to_d(data_fp32.pressure[index]));
+		const dvec1 wind_error = glm::length(data.wind_vector[index] - f_to_d(data_fp32.wind_vector[index]));
+		temperature = max(temperature, temperature_error);
+		pressure = max(pressure, pressure_error);
+		wind = max(wind, wind_error);
+		relative = max(relative, temperature_error / max(abs(data.temperature[index]), 1e-9));
+		relative = max(relative, pressure_error / max(abs(data.pressure[index]), 1e-9));
+		relative = max(relative, wind_error / max(glm::length(data.wind_vector[index]), 1e-9));
+	}
+	precision_report.temperature = temperature;
+	precision_report.pressure = pressure;
+	precision_report.wind = wind;
+	precision_report.relative = relative;
 }
 
 void Kernel::particleCompute() {
@@ -552,27 +1009,14 @@ void Kernel::particleCompute() {
 }
 
 void Kernel::calculateParticle(CPU_Particle* particle) const {
-	dvec1 distance = glm::distance(particle->transformed_position, particle->probe->transformed_position);
-
-	// Recalculate Closest Probe TODO: Make Recursive
-	bool foundClosest = false;
-	while (!foundClosest) {
-		foundClosest = true;
-		for (const CPU_Neighbor& neighbor : particle->probe->neighbors) {
-			const dvec1 dist = glm::distance(particle->transformed_position, neighbor.probe->transformed_position);
-			if (dist < distance) {
-				particle->probe = neighbor.probe;
-				distance = dist;
-				foundClosest = false;  // A closer probe was found, so keep searching
-			}
-		}
-	}
+	particle->probe = closestProbe(particle->rotation * particle->position);
 
 	dquat wind_vector = dquat(1.0, 0.0, 0.0, 0.0);
-	for (const CPU_Neighbor& neighbor : particle->probe->neighbors) {
-		const dvec1 dist = glm::distance(particle->transformed_position, neighbor.probe->transformed_position);
+	for (uint edge = probes.neighbor_offsets[particle->probe]; edge < probes.neighbor_offsets[particle->probe + 1]; edge++) {
+		const uint neighbor = probes.neighbor_index[edge];
+		const dvec1 dist = glm::distance(particle->transformed_position, probes.transformed_position[neighbor]);
 		const dvec1 smoothing_kernel = pow(glm::max(0.0, 0.25 - dist), 3.0);
-		wind_vector += neighbor.probe->data.wind_quaternion * smoothing_kernel;
+		wind_vector += probes.wind_quaternion[neighbor] * smoothing_kernel;
 	}
 
 	// Add wind to velocity
@@ -602,6 +1046,19 @@ dvec3 Kernel::rotateGeoloc(const dvec3& point, const dvec2& geoloc) const {
 	return combinedRotation * point;
 }
 
+// The sampled wind is static, only the tilt in front of it follows EARTH_TILT
+dquat Kernel::windRotation(const dvec1& wind_u, const dvec1& wind_v) const {
+	const dvec1 axialTilt = -glm::radians(EARTH_TILT);
+	const dvec1 u = glm::radians(wind_u);
+	const dvec1 v = glm::radians(wind_v);
+
+	const dquat tiltRotation = glm::angleAxis(axialTilt, dvec3(0, 0, 1));
+	const dquat uRotation  = glm::angleAxis(u,dvec3(0, 1, 0));
+	const dquat vRotation  = glm::angleAxis(v, dvec3(1, 0, 0));
+
+	return tiltRotation * uRotation * vRotation;
+}
+
 dquat Kernel::rotateGeoloc(const dvec2& geoloc) const {
 	const dvec1 phi = glm::radians(geoloc.x - 90.0);
 	const dvec1 theta = glm::radians(geoloc.y + 90.0);
@@ -624,6 +1081,15 @@ void Kernel::updateParticlePosition(CPU_Particle* particle) const {
 	particle->transformed_position = combinedRotation * particle->position;
 }
 
+dquat Kernel::earthRotation() const {
+	const dvec1 axialTilt = -glm::radians(EARTH_TILT);
+	const dvec1 theta = glm::radians(DAY_TIME * 360.0);
+
+	const dquat tiltRotation = glm::angleAxis(axialTilt, dvec3(0, 0, 1));
+	const dquat timeRotation = glm::angleAxis(theta, dvec3(0, 1, 0));
+	return tiltRotation * timeRotation;
+}
+
 dvec3 Kernel::sunDir() const {
 	const dvec2 time = dvec2(0, YEAR_TIME * TWO_PI);
 	const dvec2 c = cos(time);
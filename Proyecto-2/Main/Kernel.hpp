@@ -6,20 +6,100 @@
 
 #include "Particle.hpp"
 #include "Bvh.hpp"
+#include "Spatial.hpp"
 
 enum struct Texture_Field;
 
+// Derived data a setting change makes stale, marked by Kernel::invalidate and rebuilt before the next step by Simulation::update
+#define KERNEL_TIME      0x1U // Calendar, tilt: sun direction, earth rotation, world positions, sunlight and the tilted wind rotation
+#define KERNEL_PARTICLES 0x2U // Particle settings: particle positions and cells
+#define KERNEL_PROBES    0x4U // Probe settings: positions, texture coordinates, field samples, probe tree, BVH and particle cells
+
+// GPU columns changed since the last snapshot, folded into Kernel::gpu_versions by Kernel::snapshot
+#define GPU_PROBES       0x01U // Static probe columns, rebuild and lock
+#define GPU_PROBE_STATES 0x02U // Simulated probe columns, every step
+#define GPU_PROBE_RANGES 0x04U // Particle range of every probe slot, every particle sort
+#define GPU_PROBE_NODES  0x08U
+#define GPU_PARTICLES    0x10U // Particle positions in slot order, with their ids and rotations for the render side blend
+#define GPU_PARTICLE_ANCHORS 0x20U // Particle rest positions by id, blend only, never uploaded
+#define GPU_BLOCKS       6 // Block b is flagged by 1 << b
+
+uint f_gpuBlock(const uint& flag);
+
+// Largest divergence of the fp32 probe copy from the fp64 probes, per field
+struct Precision_Report {
+	uint64 substeps;
+	dvec1  temperature; // K
+	dvec1  pressure; // hPa
+	dvec1  wind; // m/s
+	dvec1  relative; // Largest relative error of any of the above
+
+	Precision_Report();
+};
+
+// Substep count picked by Kernel::controlSubsteps from the fastest rates at the start of a step, all in 1 / simulated time
+struct Step_Control {
+	uint  sub_samples;
+	dvec1 stable_dt; // Largest substep every limit allows
+	dvec1 advection; // Wind speed over nearest neighbor spacing
+	dvec1 relaxation; // |d net_heat / d temperature|, explicit Euler stays monotone below 1 / relaxation
+	dvec1 heating; // |net_heat|, K
+	bool  capped; // MAX_SUB_SAMPLES was hit, the step runs with a larger substep than stability asks for
+
+	Step_Control();
+};
+
+// Wall time the kernel spent per stage since it was created, s. Written by the thread stepping the kernel only,
+// a snapshot carries the running totals and the renderer charges the difference to the frame that consumes it.
+struct Kernel_Timings {
+	dvec1 probe_bvh;
+	dvec1 particle_sort;
+	dvec1 scatter;
+	dvec1 gather;
+	dvec1 particle_update;
+
+	Kernel_Timings();
+};
+
+// Everything the renderer reads of a simulated frame, filled by Kernel::snapshot and handed over by Simulation.
+// A block is only copied when its version differs from the kernel one, and only uploaded when it differs from the GPU one.
+struct Kernel_Snapshot {
+	vector<GPU_Probe>       probes;
+	vector<GPU_Probe_State> probe_states;
+	vector<uvec2>           probe_ranges;
+	vector<GPU_Bvh>         probe_nodes;
+	vector<GPU_Particle>    particles;
+	vector<uint>            particle_ids; // Per slot
+	vector<quat>            particle_rotations; // By id
+	vector<vec3>            particle_anchors; // By id
+	uint64 versions[GPU_BLOCKS];
+	dvec1  time; // Simulation::clock when published, s
+
+	dquat earth_rotation;
+	dvec1 earth_tilt;
+	dvec1 year_time;
+	dvec1 day_time;
+	ivec4 calendar; // Month, day, hour, minute
+	vec1  max_smoothing_radius;
+	vec1  particle_probe_distance;
+	Precision_Report precision_report;
+	Step_Control     step_control;
+	Kernel_Timings   timings;
+
+	Kernel_Snapshot();
+};
+
 struct Kernel {
 	vec1  PROBE_RADIUS;
 	uint  PROBE_COUNT;
 	uint  PROBE_MAX_OCTREE_DEPTH;
+	uint  PROBE_NEIGHBORS;
 	dvec1 PROBE_POLE_BIAS;
 	dvec1 PROBE_POLE_BIAS_POWER;
 	dvec2 PROBE_POLE_GEOLOCATION;
 
 	vec1  PARTICLE_RADIUS;
 	uint  PARTICLE_COUNT;
-	uint  PARTICLE_MAX_OCTREE_DEPTH;
 	dvec1 PARTICLE_POLE_BIAS;
 	dvec1 PARTICLE_POLE_BIAS_POWER;
 	dvec2 PARTICLE_POLE_GEOLOCATION;
@@ -33,25 +113,51 @@ struct Kernel {
 	int   CALENDAR_HOUR;
 	int   CALENDAR_MINUTE;
 	uint  DAY;
-	bool  BVH_SPH;
+	Bvh_Type BVH_TYPE;
 
 	dvec1 DT;
 	dvec1 SDT;
 	uint  RUNFRAME;
-	uint  SUB_SAMPLES;
+	uint  MAX_SUB_SAMPLES;
+	dvec1 COURANT; // Fraction of the stability limits a substep may use
+	uint  THREAD_COUNT;
+	bool  EXACT_THERMODYNAMICS;
+	bool  COMPARE_PRECISION;
+	uint64 SEED;
 
 	dvec3 sun_dir;
+	dquat earth_rotation;
+	uint64 substep; // Step counter of f_randD, reset at lock so a seed replays the same run
+	uint   dirty; // KERNEL_ flags
+	vec1  max_smoothing_radius;
 
 	unordered_map<Texture_Field, Texture> textures;
+	vector<const Texture*> texture_fields; // Indexed by Texture_Field, resolved once after loading
 
-	vector<CPU_Probe*>       probes;
+	Probe_Store              probes;
+	Probe_Store_T<vec1>      probes_fp32; // Stepped next to probes by COMPARE_PRECISION
+	Precision_Report         precision_report;
+	Step_Control             step_control;
+	Kernel_Timings           timings;
 	vector<CPU_Particle*>    particles;
+	Kd_Tree                  probe_tree;
 
+	vector<uint>             probe_order;
+	vector<uint>             probe_slot;
+	vector<uint>             particle_offsets;
+	vec1                     particle_probe_distance;
 	vector<GPU_Probe>        gpu_probes;
+	vector<GPU_Probe_State>  gpu_probe_states;
+	vector<uvec2>            gpu_probe_ranges;
+	uint                     gpu_dirty; // GPU_ flags
+	uint64                   gpu_versions[GPU_BLOCKS];
 	vector<GPU_Particle>     gpu_particles;
+	vector<uint>             gpu_particle_ids;
+	vector<quat>             gpu_particle_rotations;
+	vector<vec3>             gpu_particle_anchors;
 
 	vector<GPU_Bvh>          probe_nodes;
-	vector<GPU_Bvh>          particle_nodes;
+	Octree_Builder           probe_octree;
 
 	vector<Compute_Probe>    compute_probes;
 	vector<Compute_Particle> compute_particles;
@@ -59,37 +165,56 @@ struct Kernel {
 
 	Kernel();
 
-	void traceInitProperties(CPU_Probe* probe) const;
+	void traceInitProperties(const uint& index);
 
 	void updateGPUProbes();
+	void updateGPUProbeData();
+	void updateGPUProbeStates();
+	void benchmarkBvh(const uint& ray_count) const;
 	void buildProbes();
+	void sampleProbes();
 
 	void updateGPUParticles();
+	void updateParticleRanges();
 	void buildParticles();
 
+	void invalidate(const uint& flags);
+	void snapshot(Kernel_Snapshot& target);
+	void resampleTime();
+
 	void lock();
+	void buildProbeTree();
 	void lockProbes();
 	void lockParticles();
+	uint closestProbe(const dvec3& position) const;
 
 	void simulate(const dvec1& delta_time);
+	void controlSubsteps();
 	void updateTime();
-	void updateProbePosition(CPU_Probe* probe) const;
-	void calculateSunlight(CPU_Probe* probe) const;
+	void resetComparison();
+	void comparePrecision();
+
+	template <typename T> void scatterProbes(Probe_Store_T<T>& store);
+	template <typename T> void gatherProbes(Probe_Store_T<T>& store);
+	template <typename T> void updateProbePosition(Probe_Store_T<T>& store, const uint& index);
+	template <typename T> void calculateSunlight(Probe_Store_T<T>& store, const uint& start, const uint& end);
 
-	void scatterSPH(CPU_Probe* probe) const;
-	void scatterWind(CPU_Probe* probe) const;
-	void gatherWind(CPU_Probe* probe) const;
-	void gatherThermodynamics(CPU_Probe* probe) const;
+	template <typename T> void scatterSPH(Probe_Store_T<T>& store, const uint& index);
+	template <typename T> void scatterWind(Probe_Store_T<T>& store, const uint& index);
+	template <typename T> void gatherWind(Probe_Store_T<T>& store, const uint& index);
+	template <typename T> void gatherThermodynamics(Probe_Store_T<T>& store, const uint& start, const uint& end);
 
 	void particleCompute();
 	void calculateParticle(CPU_Particle* particle) const;
 	void updateParticlePosition(CPU_Particle* particle) const;
 
 	dvec3 sunDir() const;
+	dquat earthRotation() const;
 	void calculateDate();
 	void calculateDateTime();
 	void calculateYearTime();
 	void calculateDayTime();
 	dvec3 rotateGeoloc(const dvec3& point, const dvec2& geoloc) const;
 	dquat rotateGeoloc(const dvec2& geoloc) const;
+	dquat windRotation(const dvec1& wind_u, const dvec1& wind_v) const;
 };
\ No newline at end of file
@@ -1,56 +1,169 @@
 #include "Particle.hpp"
 
-CPU_Probe_Data::CPU_Probe_Data() {
-	position = dvec3(0);
-	wind_vector  = dvec3(0);
-	wind_u = 0;
-	wind_v = 0;
-	wind_quaternion = glm::normalize(dquat(randD(), randD(), randD(), randD()));
-	surface_area = 1;
+template <typename T>
+void Probe_State_T<T>::resize(const uint& count) {
+	wind_vector.assign(count, tvec3<T>(0));
+	pressure.assign(count, 0.0);
+	temperature.assign(count, 0.0);
+	sun_intensity.assign(count, 0.0);
+	solar_irradiance.assign(count, 0.0);
+}
 
-	height = 0;
-	pressure = 0;
-	temperature = 0;
-	day_temperature = 0;
-	night_temperature = 0;
-	humidity = 0;
-	water_vapor = 0;
-	cloud_coverage = 0;
-	cloud_water_content = 0;
-	cloud_particle_radius = 0;
-	cloud_optical_thickness = 0;
-	ozone = 0;
-	albedo = 0;
-	uv_index = 0;
-	emissivity = 0;
-	sun_intensity = 0;
-	net_radiation = 0;
-	solar_insolation = 0;
-	solar_irradiance = 0;
-	outgoing_longwave_radiation = 0;
-	reflected_shortwave_radiation = 0;
-	on_water = false;
+template <typename T>
+Probe_Store_T<T>::Probe_Store_T() :
+	count(0),
+	front(0)
+{}
+
+template <typename T>
+void Probe_Store_T<T>::resize(const uint& count) {
+	this->count = count;
+
+	gen_index.assign(count, 0);
+	position.assign(count, tvec3<T>(0));
+	transformed_position.assign(count, tvec3<T>(0));
+	uv.assign(count, vec2(0));
+	smoothing_radius.assign(count, 0.0);
+	wind_u.assign(count, 0.0);
+	wind_v.assign(count, 0.0);
+	wind_quaternion.assign(count, dquat(1, 0, 0, 0));
+	convection_coefficient.assign(count, 1.0);
+	surface_area.assign(count, 1.0);
+
+	height.assign(count, 0.0);
+	day_temperature.assign(count, 0.0);
+	night_temperature.assign(count, 0.0);
+
+	humidity.assign(count, 0.0);
+	water_vapor.assign(count, 0.0);
+	cloud_coverage.assign(count, 0.0);
+	cloud_water_content.assign(count, 0.0);
+	cloud_particle_radius.assign(count, 0.0);
+	cloud_optical_thickness.assign(count, 0.0);
+
+	ozone.assign(count, 0.0);
+	albedo.assign(count, 0.0);
+	uv_index.assign(count, 0.0);
+	emissivity.assign(count, 0.0);
+	net_radiation.assign(count, 0.0);
+	solar_insolation.assign(count, 0.0);
+	outgoing_longwave_radiation.assign(count, 0.0);
+	reflected_shortwave_radiation.assign(count, 0.0);
+
+	on_water.assign(count, 0);
+
+	states[0].resize(count);
+	states[1].resize(count);
+	front = 0;
+
+	sph_wind_vector.assign(count, tvec3<T>(0));
+	sph_pressure.assign(count, 0.0);
+	sph_temperature.assign(count, 0.0);
+
+	resizeNeighbors(0);
 }
 
-CPU_Probe::CPU_Probe() :
-	new_data(CPU_Probe_Data()),
-	data(CPU_Probe_Data()),
-	sph(CPU_Probe_Data())
-{
-	gen_index = 0;
+// Copies what the simulation stages read and write, converted to this precision
+template <typename T>
+void Probe_Store_T<T>::convert(const Probe_Store_T<dvec1>& reference) {
+	const auto copy = [](auto& target, const auto& source) {
+		typedef typename std::decay<decltype(target)>::type::value_type Value;
+		target.resize(source.size());
+		for (uint64 i = 0; i < source.size(); i++) {
+			target[i] = Value(source[i]);
+		}
+	};
+	count = reference.count;
+	front = reference.front;
+	copy(position, reference.position);
+	copy(transformed_position, reference.transformed_position);
+	copy(wind_u, reference.wind_u);
+	copy(wind_v, reference.wind_v);
+	copy(convection_coefficient, reference.convection_coefficient);
+	copy(surface_area, reference.surface_area);
+	copy(albedo, reference.albedo);
+	copy(emissivity, reference.emissivity);
+	copy(solar_insolation, reference.solar_insolation);
+	for (uint i = 0; i < 2; i++) {
+		copy(states[i].wind_vector, reference.states[i].wind_vector);
+		copy(states[i].pressure, reference.states[i].pressure);
+		copy(states[i].temperature, reference.states[i].temperature);
+		copy(states[i].sun_intensity, reference.states[i].sun_intensity);
+		copy(states[i].solar_irradiance, reference.states[i].solar_irradiance);
+	}
+	copy(sph_wind_vector, reference.sph_wind_vector);
+	copy(sph_pressure, reference.sph_pressure);
+	copy(sph_temperature, reference.sph_temperature);
+	copy(neighbor_offsets, reference.neighbor_offsets);
+	copy(neighbor_index, reference.neighbor_index);
+	copy(neighbor_distance, reference.neighbor_distance);
+	copy(neighbor_weight, reference.neighbor_weight);
+	copy(neighbor_inverse_weight, reference.neighbor_inverse_weight);
+	copy(neighbor_direction, reference.neighbor_direction);
+}
 
-	transformed_position = dvec3(0);
-	smoothing_radius = 0.0f;
+template <typename T>
+void Probe_Store_T<T>::resizeNeighbors(const uint& neighbor_count) {
+	const uint64 edges = u_to_ul(count) * neighbor_count;
+	neighbor_offsets.resize(u_to_ul(count) + 1);
+	for (uint i = 0; i <= count; i++) {
+		neighbor_offsets[i] = i * neighbor_count;
+	}
+	neighbor_index.assign(edges, 0);
+	neighbor_distance.assign(edges, 0.0);
+	neighbor_weight.assign(edges, 0.0);
+	neighbor_inverse_weight.assign(edges, 0.0);
+	neighbor_direction.assign(edges, tvec3<T>(0));
 }
 
+template <typename T>
+uint Probe_Store_T<T>::neighborCount(const uint& index) const {
+	return neighbor_offsets[index + 1] - neighbor_offsets[index];
+}
+
+template <typename T>
+void Probe_Store_T<T>::clear() {
+	resize(0);
+}
+
+template <typename T>
+uint Probe_Store_T<T>::size() const {
+	return count;
+}
+
+template <typename T>
+Probe_State_T<T>& Probe_Store_T<T>::current() {
+	return states[front];
+}
+
+template <typename T>
+const Probe_State_T<T>& Probe_Store_T<T>::current() const {
+	return states[front];
+}
+
+template <typename T>
+Probe_State_T<T>& Probe_Store_T<T>::next() {
+	return states[front ^ 1];
+}
+
+template <typename T>
+void Probe_Store_T<T>::swap() {
+	front ^= 1;
+}
+
+template struct Probe_State_T<vec1>;
+template struct Probe_State_T<dvec1>;
+template struct Probe_Store_T<vec1>;
+template struct Probe_Store_T<dvec1>;
+
 GPU_Probe::GPU_Probe() {
 	position = vec3(0);
-	wind_vector  = vec3(0);
-	sun_intensity = 0;
-
 	height = 0;
-	pressure = 0;
-	temperature = 0;
+	wind_u = 0;
+	wind_v = 0;
+	gen_index = 0;
+	smoothing_radius = 0;
+
 	day_temperature = 0;
 	night_temperature = 0;
 	humidity = 0;
@@ -66,84 +179,98 @@ GPU_Probe::GPU_Probe() {
 	solar_insolation = 0;
 	outgoing_longwave_radiation = 0;
 	reflected_shortwave_radiation = 0;
-	gen_index = 0;
-	smoothing_radius = 0;
-
-	sph_pressure = 0;
-	sph_wind_vector = vec3(0);
-	sph_temperature = 0;
+	padding = 0;
 }
 
-GPU_Probe::GPU_Probe(const CPU_Probe* particle) {
-	gen_index = particle->gen_index;
-	smoothing_radius = d_to_f(particle->smoothing_radius);
+GPU_Probe::GPU_Probe(const Probe_Store& probes, const uint& index) {
+	gen_index = probes.gen_index[index];
+	smoothing_radius = d_to_f(probes.smoothing_radius[index]);
 
-	position      = d_to_f(particle->transformed_position);
-	wind_vector   = d_to_f(particle->data.wind_vector);
-	sun_intensity = d_to_f(particle->data.sun_intensity);
+	position = d_to_f(probes.position[index]); // Body frame, rays are rotated into it by the shader
+	height   = d_to_f(probes.height[index]);
 
-	wind_u = d_to_f(particle->data.wind_u);
-	wind_v = d_to_f(particle->data.wind_v);
+	wind_u = d_to_f(probes.wind_u[index]);
+	wind_v = d_to_f(probes.wind_v[index]);
 
-	height            = d_to_f(particle->data.height);
-	pressure          = d_to_f(particle->data.pressure);
-	temperature       = d_to_f(particle->data.temperature);
-	day_temperature   = d_to_f(particle->data.day_temperature);
-	night_temperature = d_to_f(particle->data.night_temperature);
+	day_temperature   = d_to_f(probes.day_temperature[index]);
+	night_temperature = d_to_f(probes.night_temperature[index]);
 
-	humidity                = d_to_f(particle->data.humidity);
-	water_vapor             = d_to_f(particle->data.water_vapor);
-	cloud_coverage          = d_to_f(particle->data.cloud_coverage);
-	cloud_water_content     = d_to_f(particle->data.cloud_water_content);
-	cloud_particle_radius   = d_to_f(particle->data.cloud_particle_radius);
-	cloud_optical_thickness = d_to_f(particle->data.cloud_optical_thickness);
+	humidity                = d_to_f(probes.humidity[index]);
+	water_vapor             = d_to_f(probes.water_vapor[index]);
+	cloud_coverage          = d_to_f(probes.cloud_coverage[index]);
+	cloud_water_content     = d_to_f(probes.cloud_water_content[index]);
+	cloud_particle_radius   = d_to_f(probes.cloud_particle_radius[index]);
+	cloud_optical_thickness = d_to_f(probes.cloud_optical_thickness[index]);
 
-	ozone                         = d_to_f(particle->data.ozone);
-	albedo                        = d_to_f(particle->data.albedo);
-	uv_index                      = d_to_f(particle->data.uv_index);
-	net_radiation                 = d_to_f(particle->data.net_radiation);
-	solar_insolation              = d_to_f(particle->data.solar_insolation);
-	outgoing_longwave_radiation   = d_to_f(particle->data.outgoing_longwave_radiation);
-	reflected_shortwave_radiation = d_to_f(particle->data.reflected_shortwave_radiation);
+	ozone                         = d_to_f(probes.ozone[index]);
+	albedo                        = d_to_f(probes.albedo[index]);
+	uv_index                      = d_to_f(probes.uv_index[index]);
+	net_radiation                 = d_to_f(probes.net_radiation[index]);
+	solar_insolation              = d_to_f(probes.solar_insolation[index]);
+	outgoing_longwave_radiation   = d_to_f(probes.outgoing_longwave_radiation[index]);
+	reflected_shortwave_radiation = d_to_f(probes.reflected_shortwave_radiation[index]);
+	padding = 0;
+}
 
-	sph_pressure    = d_to_f(particle->sph.pressure);
-	sph_wind_vector = d_to_f(particle->sph.wind_vector);
-	sph_temperature = d_to_f(particle->sph.temperature);
+GPU_Probe_State::GPU_Probe_State() {
+	wind_vector = vec3(0);
+	sun_intensity = 0;
+	sph_wind_vector = vec3(0);
+	sph_temperature = 0;
+	pressure = 0;
+	temperature = 0;
+	sph_pressure = 0;
+	padding = 0;
 }
 
-CPU_Neighbor::CPU_Neighbor(const dvec1& distance, CPU_Probe* neighbor) :
-	distance(distance),
-	probe(neighbor)
-{}
+GPU_Probe_State::GPU_Probe_State(const Probe_Store& probes, const uint& index) {
+	const Probe_State& data = probes.current();
+	wind_vector   = d_to_f(data.wind_vector[index]);
+	sun_intensity = d_to_f(data.sun_intensity[index]);
+
+	sph_wind_vector = d_to_f(probes.sph_wind_vector[index]);
+	sph_temperature = d_to_f(probes.sph_temperature[index]);
+
+	pressure     = d_to_f(data.pressure[index]);
+	temperature  = d_to_f(data.temperature[index]);
+	sph_pressure = d_to_f(probes.sph_pressure[index]);
+	padding = 0;
+}
 
 CPU_Particle::CPU_Particle() :
 	transformed_position(dvec3(0)),
 	position(dvec3(0)),
-	wind_speed(glm::normalize(dquat(randD(), randD(), randD(), randD()))),
+	wind_speed(dquat(1, 0, 0, 0)),
 	rotation(dquat(1,0,0,0)),
-	probe(nullptr)
+	probe(MAX_UINT32),
+	id(0)
 {}
 
 GPU_Particle::GPU_Particle(const CPU_Particle* particle) :
-	position(d_to_f(particle->transformed_position), 0.0f)
+	position(d_to_f(particle->rotation * particle->position), 0.0f) // Body frame, traced through the probe BVH
 {}
 
 GPU_Particle::GPU_Particle(const Compute_Particle& particle) :
 	position(particle.position, 0.0f)
 {}
 
-Compute_Probe::Compute_Probe(const CPU_Probe& probe, CPU_Probe* first) {
-	position = vec4(d_to_f(probe.transformed_position), 0.0f);
-	wind_speed = vec4(d_to_f(probe.data.wind_quaternion.w), d_to_f(probe.data.wind_quaternion.x), d_to_f(probe.data.wind_quaternion.y), d_to_f(probe.data.wind_quaternion.z));
+GPU_Particle::GPU_Particle(const vec3& position) :
+	position(position, 0.0f)
+{}
+
+Compute_Probe::Compute_Probe(const Probe_Store& probes, const uint& index) {
+	const dquat& wind_quaternion = probes.wind_quaternion[index];
+	position = vec4(d_to_f(probes.transformed_position[index]), 0.0f);
+	wind_speed = vec4(d_to_f(wind_quaternion.w), d_to_f(wind_quaternion.x), d_to_f(wind_quaternion.y), d_to_f(wind_quaternion.z));
 	neighbors = uvec3(0);
 
-	neighbors[0] = (int)(probe.neighbors[0].probe - first);
-	neighbors[1] = (int)(probe.neighbors[1].probe - first);
-	neighbors[2] = (int)(probe.neighbors[2].probe - first);
+	for (uint k = 0; k < min(probes.neighborCount(index), 3U); k++) {
+		neighbors[k] = probes.neighbor_index[probes.neighbor_offsets[index] + k];
+	}
 }
 
-Compute_Particle::Compute_Particle(const CPU_Particle& particle, CPU_Probe* first) {
+Compute_Particle::Compute_Particle(const CPU_Particle& particle) {
 	position = particle.transformed_position;
-	closest = (int)(particle.probe - first);
+	closest = particle.probe;
 	rotation = vec4(d_to_f(particle.wind_speed.w), d_to_f(particle.wind_speed.x), d_to_f(particle.wind_speed.y), d_to_f(particle.wind_speed.z));
 }
\ No newline at end of file
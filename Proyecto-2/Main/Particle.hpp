@@ -2,77 +2,110 @@
 
 #include "Shared.hpp"
 
-struct CPU_Neighbor;
-struct CPU_Probe;
+template <typename T> struct Probe_State_T;
+template <typename T> struct Probe_Store_T;
 struct GPU_Probe;
 struct CPU_Particle;
 struct GPU_Particle;
 struct Compute_Probe;
 struct Compute_Particle;
 
-struct CPU_Probe_Data {
-	dvec3 position; // mm (mega) meters
-	dvec3 wind_vector; // m/s
-	dvec1 wind_u;
-	dvec1 wind_v;
-	dquat wind_quaternion;
-	dvec1 surface_area; // mm (mega) meters
-
-	dvec1 height; // m
-	dvec1 pressure; // hPa
-	dvec1 temperature; // K
-	dvec1 day_temperature; // K
-	dvec1 night_temperature; // K
-
-	dvec1 humidity;
-	dvec1 water_vapor; // cm
-	dvec1 cloud_coverage; // %
-	dvec1 cloud_water_content; // g/m^2
-	dvec1 cloud_particle_radius; // μm
-	dvec1 cloud_optical_thickness; // 0-50%
-
-	dvec1 ozone; // Dobson
-	dvec1 albedo; // %
-	dvec1 uv_index; // 0-16
-	dvec1 emissivity; // %
-	dvec1 sun_intensity; // %
-	dvec1 net_radiation; // W/m^2
-	dvec1 solar_insolation; // W/m^2
-	dvec1 solar_irradiance; // W/m^2
-	dvec1 outgoing_longwave_radiation; // W/m^2
-	dvec1 reflected_shortwave_radiation; // W/m^2
-
-	bool on_water;
-
-	CPU_Probe_Data();
-};
+template <typename T>
+using tvec3 = glm::vec<3, T>;
 
-struct CPU_Probe {
-	uint gen_index;
-	CPU_Probe_Data new_data;
-	CPU_Probe_Data data;
-	CPU_Probe_Data sph;
-	dvec3 transformed_position;
+// Fields advanced by the simulation, a substep reads one state and writes every field of the other
+template <typename T>
+struct Probe_State_T {
+	Aligned_Array<tvec3<T>> wind_vector; // m/s
+	Aligned_Array<T>        pressure; // hPa
+	Aligned_Array<T>        temperature; // K
+	Aligned_Array<T>        sun_intensity; // %
+	Aligned_Array<T>        solar_irradiance; // W/m^2
 
-	dvec1 smoothing_radius;
-	vector<CPU_Neighbor> neighbors;
-
-	CPU_Probe();
+	void resize(const uint& count);
 };
 
-struct CPU_Neighbor {
-	dvec1 distance;
-	CPU_Probe* probe;
-
-	CPU_Neighbor(const dvec1& distance, CPU_Probe* neighbor);
+// Structure of arrays probe storage: one contiguous aligned array per field, probes are addressed by a 32-bit index.
+// Templated on the scalar type, the kernel keeps fp64 and can step an fp32 copy next to it to measure the divergence
+template <typename T>
+struct Probe_Store_T {
+	uint count;
+
+	Aligned_Array<uint>     gen_index;
+	Aligned_Array<tvec3<T>> position; // mm (mega) meters
+	Aligned_Array<tvec3<T>> transformed_position;
+	Aligned_Array<vec2>     uv; // Texture coordinates, fixed in the body frame so they are computed with the position
+	Aligned_Array<T>        smoothing_radius;
+	Aligned_Array<T>        wind_u;
+	Aligned_Array<T>        wind_v;
+	Aligned_Array<dquat>    wind_quaternion;
+	Aligned_Array<T>        convection_coefficient; // (1 + |wind_uv|)^0.35, the sampled wind is static
+	Aligned_Array<T>        surface_area; // mm (mega) meters
+
+	Aligned_Array<T>        height; // m
+	Aligned_Array<T>        day_temperature; // K
+	Aligned_Array<T>        night_temperature; // K
+
+	Aligned_Array<T>        humidity;
+	Aligned_Array<T>        water_vapor; // cm
+	Aligned_Array<T>        cloud_coverage; // %
+	Aligned_Array<T>        cloud_water_content; // g/m^2
+	Aligned_Array<T>        cloud_particle_radius; // μm
+	Aligned_Array<T>        cloud_optical_thickness; // 0-50%
+
+	Aligned_Array<T>        ozone; // Dobson
+	Aligned_Array<T>        albedo; // %
+	Aligned_Array<T>        uv_index; // 0-16
+	Aligned_Array<T>        emissivity; // %
+	Aligned_Array<T>        net_radiation; // W/m^2
+	Aligned_Array<T>        solar_insolation; // W/m^2
+	Aligned_Array<T>        outgoing_longwave_radiation; // W/m^2
+	Aligned_Array<T>        reflected_shortwave_radiation; // W/m^2
+
+	Aligned_Array<uint8>    on_water;
+
+	// Ping-pong simulation state, swapped by index after every substep
+	Probe_State_T<T> states[2];
+	uint front;
+
+	// Smoothed neighborhood values written by scatter
+	Aligned_Array<tvec3<T>> sph_wind_vector;
+	Aligned_Array<T>        sph_pressure;
+	Aligned_Array<T>        sph_temperature;
+
+	// Compressed sparse row neighbor graph built at lock, probe i owns [neighbor_offsets[i], neighbor_offsets[i + 1])
+	Aligned_Array<uint>     neighbor_offsets;
+	Aligned_Array<uint>     neighbor_index;
+	Aligned_Array<T>        neighbor_distance;
+	Aligned_Array<T>        neighbor_weight; // (h_i - d)^3, smoothing kernel of the probe
+	Aligned_Array<T>        neighbor_inverse_weight; // (h_j - d)^3, smoothing kernel of the neighbor
+	Aligned_Array<tvec3<T>> neighbor_direction; // Unit vector towards the neighbor, body frame
+
+	Probe_Store_T();
+
+	void resize(const uint& count);
+	void convert(const Probe_Store_T<dvec1>& reference);
+	void resizeNeighbors(const uint& neighbor_count);
+	uint neighborCount(const uint& index) const;
+	void clear();
+	uint size() const;
+
+	Probe_State_T<T>& current();
+	const Probe_State_T<T>& current() const;
+	Probe_State_T<T>& next();
+	void swap();
 };
 
+typedef Probe_State_T<dvec1> Probe_State;
+typedef Probe_Store_T<dvec1> Probe_Store;
+
 struct CPU_Particle {
 	dquat rotation;
 	dquat wind_speed;
 	dvec3 position;
 	dvec3 transformed_position;
-	CPU_Probe* probe;
+	uint  probe;
+	uint  id; // Build index, stable while the particles are sorted by probe
 
 	CPU_Particle();
 };
@@ -82,50 +115,58 @@ struct alignas(16) GPU_Particle {
 
 	GPU_Particle(const CPU_Particle* particle);
 	GPU_Particle(const Compute_Particle& particle);
+	GPU_Particle(const vec3& position);
 };
 
+// Static columns of a probe, 96 bytes. Rewritten at rebuild and lock only, the simulated fields live in GPU_Probe_State
 struct alignas(16) GPU_Probe {
 	vec3 position;
 	vec1 height;
 
-	vec3 wind_vector;
-	vec1 sun_intensity;
-
 	vec1 wind_u;
 	vec1 wind_v;
-	vec2 padding = vec2(0);
+	uint gen_index;
+	vec1 smoothing_radius;
 
-	vec1 pressure;
-	vec1 temperature;
 	vec1 day_temperature;
 	vec1 night_temperature;
-
 	vec1 humidity;
 	vec1 water_vapor;
+
 	vec1 cloud_coverage;
 	vec1 cloud_water_content;
-
 	vec1 cloud_particle_radius;
 	vec1 cloud_optical_thickness;
+
 	vec1 ozone;
 	vec1 albedo;
-
 	vec1 uv_index;
 	vec1 net_radiation;
+
 	vec1 solar_insolation;
 	vec1 outgoing_longwave_radiation;
-
 	vec1 reflected_shortwave_radiation;
-	uint gen_index;
-	vec1 smoothing_radius;
+	vec1 padding;
 
-	vec1 sph_pressure;
+	GPU_Probe();
+	GPU_Probe(const Probe_Store& probes, const uint& index);
+};
+
+// Simulated columns of a probe, 48 bytes, converted and uploaded after every step
+struct alignas(16) GPU_Probe_State {
+	vec3 wind_vector;
+	vec1 sun_intensity;
 
 	vec3 sph_wind_vector;
 	vec1 sph_temperature;
 
-	GPU_Probe();
-	GPU_Probe(const CPU_Probe* probe);
+	vec1 pressure;
+	vec1 temperature;
+	vec1 sph_pressure;
+	vec1 padding;
+
+	GPU_Probe_State();
+	GPU_Probe_State(const Probe_Store& probes, const uint& index);
 };
 
 struct alignas(16) Compute_Probe {
@@ -134,7 +175,7 @@ struct alignas(16) Compute_Probe {
 	uvec3 neighbors;
 	vec1  padding = 0.0f;
 
-	Compute_Probe(const CPU_Probe& probe, CPU_Probe* first);
+	Compute_Probe(const Probe_Store& probes, const uint& index);
 };
 
 struct alignas(16) Compute_Particle {
@@ -142,5 +183,5 @@ struct alignas(16) Compute_Particle {
 	uint closest;
 	vec4 rotation;
 
-	Compute_Particle(const CPU_Particle& particle, CPU_Probe* first);
+	Compute_Particle(const CPU_Particle& particle);
 };
\ No newline at end of file
@@ -17,7 +17,6 @@ PathTracer::PathTracer(Renderer* renderer) :
 	render_probe_lighting    = false;
 	render_particle_lighting = false;
 	render_probe_octree      = false;
-	render_particle_octree   = false;
 	{
 		render_octree_hue         = false;
 		render_octree_debug       = false;
@@ -29,6 +28,9 @@ PathTracer::PathTracer(Renderer* renderer) :
 		render_probe_color_mode = 1;
 	}
 	render_planet_texture = 0;
+	for (uint i = 0; i < GPU_BLOCKS; i++) {
+		gpu_versions[i] = 0;
+	}
 }
 
 void PathTracer::f_initialize() {
@@ -44,13 +46,15 @@ void PathTracer::f_initialize() {
 
 	gl_data["raw_render_layer"] = 0;
 
-	gl_data["ssbo 1"] = 0;
-	gl_data["ssbo 2"] = 0;
-	gl_data["ssbo 3"] = 0;
-	gl_data["ssbo 4"] = 0;
 	gl_data["ssbo 5"] = 0;
 	gl_data["ssbo 6"] = 0;
 
+	ssbo_rings[1] = Ssbo_Ring();
+	ssbo_rings[2] = Ssbo_Ring();
+	ssbo_rings[3] = Ssbo_Ring();
+	ssbo_rings[4] = Ssbo_Ring();
+	ssbo_rings[7] = Ssbo_Ring();
+
 	glClearColor(0, 0, 0, 0);
 
 	const GLfloat vertices[16] = {
@@ -104,23 +108,35 @@ void PathTracer::f_initialize() {
 		renderer->f_resize();
 }
 
-void PathTracer::f_updateProbes() {
+// Only the blocks whose version changed since the last upload are written, a simulation step touches the probe states and ranges only.
+// Blocks in blended are left to f_updateBlend.
+void PathTracer::f_updateSnapshot(const Kernel_Snapshot& snapshot, const uint& blended) {
 	START_TIMER("Transfer");
-	glDeleteBuffers(1, &gl_data["ssbo 1"]);
-	glDeleteBuffers(1, &gl_data["ssbo 2"]);
-	gl_data["ssbo 1"] = ssboBindingDynamic(ul_to_u(renderer->kernel.gpu_probes.size() * sizeof(GPU_Probe)), renderer->kernel.gpu_probes.data());
-	gl_data["ssbo 2"] = ssboBindingDynamic(ul_to_u(renderer->kernel.probe_nodes.size() * sizeof(GPU_Bvh)), renderer->kernel.probe_nodes.data());
+	const auto upload = [&](const auto& block, const GLuint& binding, const uint& flag) {
+		const uint i = f_gpuBlock(flag);
+		if (gpu_versions[i] != snapshot.versions[i] and !(blended & flag)) {
+			ssbo_rings[binding].write(block.data(), block.size() * sizeof(block[0]));
+			gpu_versions[i] = snapshot.versions[i];
+		}
+	};
+	upload(snapshot.probes, 1, GPU_PROBES);
+	upload(snapshot.probe_nodes, 2, GPU_PROBE_NODES);
+	upload(snapshot.particles, 3, GPU_PARTICLES);
+	upload(snapshot.probe_states, 4, GPU_PROBE_STATES);
+	upload(snapshot.probe_ranges, 7, GPU_PROBE_RANGES);
 	ADD_TIMER("Transfer");
 }
 
-// TODO, persistent GPU_DATA to avoid expensive overwrites
-
-void PathTracer::f_updateParticles() {
+// The blended blocks no longer match any snapshot version, so the newest one is uploaded again once blending stops
+void PathTracer::f_updateBlend(const Snapshot_Blend& blend) {
+	if (!blend.fresh) {
+		return;
+	}
 	START_TIMER("Transfer");
-	glDeleteBuffers(1, &gl_data["ssbo 3"]);
-	glDeleteBuffers(1, &gl_data["ssbo 4"]);
-	gl_data["ssbo 3"] = ssboBindingDynamic(ul_to_u(renderer->kernel.gpu_particles.size() * sizeof(GPU_Particle)), renderer->kernel.gpu_particles.data());
-	gl_data["ssbo 4"] = ssboBindingDynamic(ul_to_u(renderer->kernel.particle_nodes.size() * sizeof(GPU_Bvh)), renderer->kernel.particle_nodes.data());
+	ssbo_rings[3].write(blend.blended_particles.data(), blend.blended_particles.size() * sizeof(GPU_Particle));
+	ssbo_rings[4].write(blend.blended_states.data(), blend.blended_states.size() * sizeof(GPU_Probe_State));
+	gpu_versions[f_gpuBlock(GPU_PARTICLES)] = MAX_UINT64;
+	gpu_versions[f_gpuBlock(GPU_PROBE_STATES)] = MAX_UINT64;
 	ADD_TIMER("Transfer");
 }
 
@@ -151,8 +167,13 @@ void PathTracer::f_updateTextures(const bool& high_res) {
 		"Outgoing Longwave Radiation",
 		"Reflected Shortwave Radiation"
 	};
+	// Decoded in parallel, appended in order so the texture indices stay those of texture_names
+	vector<future<Texture>> loading;
 	for (const string& tex : texture_names) {
-		Texture texture = Texture::fromFile("./Resources/Data/" + tex + ".png", Texture_Format::RGBA_8);
+		loading.push_back(f_async([tex]() { return Texture::fromFile("./Resources/Data/" + tex + ".png", Texture_Format::RGBA_8); }));
+	}
+	for (future<Texture>& load : loading) {
+		const Texture texture = load.get();
 		textures.push_back(GPU_Texture(ul_to_u(texture_data.size()), texture.resolution.x, texture.resolution.y, 0));
 		auto data = texture.toRgba8Texture();
 		texture_data.insert(texture_data.end(), data.begin(), data.end());
@@ -171,23 +192,29 @@ void PathTracer::f_guiUpdate(const vec1& availableWidth, const vec1& spacing, co
 			renderer->f_resize();
 		}
 		ImGui::Checkbox("Use Probe Octree", &use_probe_octree);
-		ImGui::Checkbox("Use Particle Octree", &use_particle_octree);
-		if (!renderer->run_sim and use_probe_octree and render_probe_color_mode < SPH) {
+		ImGui::Checkbox("Use Particle Cells", &use_particle_octree);
+		if (!renderer->run_sim) {
+			const char* items_a[] = { "Octree", "LBVH", "SAH" };
+			int BVH_TYPE = static_cast<int>(renderer->kernel.BVH_TYPE);
+			ImGui::Text("BVH Builder");
+			if (ImGui::Combo("##BVH_TYPE", &BVH_TYPE, items_a, IM_ARRAYSIZE(items_a))) {
+				renderer->kernel.BVH_TYPE = static_cast<Bvh_Type>(BVH_TYPE);
+				renderer->kernel.updateGPUProbes();
+				renderer->kernel.updateGPUParticles();
+				renderer->simulation.publish();
+			}
+			if (ImGui::Button("Benchmark BVH Traversal", ImVec2(itemWidth, 0))) {
+				renderer->kernel.benchmarkBvh(16384);
+			}
+		}
+		if (!renderer->run_sim and use_probe_octree and renderer->kernel.BVH_TYPE == Bvh_Type::OCTREE) {
 			int MAX_OCTREE_DEPTH = u_to_i(renderer->kernel.PROBE_MAX_OCTREE_DEPTH);
 			ImGui::Text("Max Probe Octree Depth");
 			if (ImGui::SliderInt("##PROBE_MAX_OCTREE_DEPTH", &MAX_OCTREE_DEPTH, 0, 6)) {
 				renderer->kernel.PROBE_MAX_OCTREE_DEPTH = i_to_u(MAX_OCTREE_DEPTH);
 				renderer->kernel.updateGPUProbes();
-				f_updateProbes();
-			}
-		}
-		if (!renderer->run_sim and use_particle_octree) {
-			int MAX_OCTREE_DEPTH = u_to_i(renderer->kernel.PARTICLE_MAX_OCTREE_DEPTH);
-			ImGui::Text("Max Particle Octree Depth");
-			if (ImGui::SliderInt("##PARTICLE_MAX_OCTREE_DEPTH", &MAX_OCTREE_DEPTH, 0, 6)) {
-				renderer->kernel.PARTICLE_MAX_OCTREE_DEPTH = i_to_u(MAX_OCTREE_DEPTH);
 				renderer->kernel.updateGPUParticles();
-				f_updateParticles();
+				renderer->simulation.publish();
 			}
 		}
 	}
@@ -208,7 +235,6 @@ void PathTracer::f_guiUpdate(const vec1& availableWidth, const vec1& spacing, co
 			if (use_probe_octree) {
 				if (ImGui::Checkbox("Render Probe Octree", &render_probe_octree)) {
 					render_octree_debug_index = 0;
-					render_particle_octree = false;
 				}
 				if (render_probe_octree) {
 					ImGui::Checkbox("Hue", &render_octree_hue);
@@ -219,20 +245,6 @@ void PathTracer::f_guiUpdate(const vec1& availableWidth, const vec1& spacing, co
 					}
 				}
 			}
-			if (use_particle_octree) {
-				if (ImGui::Checkbox("Render Particle Octree", &render_particle_octree)) {
-					render_octree_debug_index = 0;
-					render_probe_octree = false;
-				}
-				if (render_particle_octree) {
-					ImGui::Checkbox("Hue", &render_octree_hue);
-					ImGui::Checkbox("Debug", &render_octree_debug);
-					if (render_octree_debug) {
-						ImGui::Text("Index");
-						ImGui::SliderInt("##render_octree_debug_index", &render_octree_debug_index, 0, ul_to_i(renderer->kernel.particle_nodes.size()));
-					}
-				}
-			}
 		}
 
 		ImGui::Checkbox("Render Probes", &render_probes);
@@ -240,39 +252,24 @@ void PathTracer::f_guiUpdate(const vec1& availableWidth, const vec1& spacing, co
 			ImGui::Checkbox("Render Probe Lighting", &render_probe_lighting);
 			if (render_probe_color_mode < SPH) {
 				ImGui::Text("Probe Display Radius");
-				if (ImGui::SliderFloat("##PROBE_RADIUS", &renderer->kernel.PROBE_RADIUS, 0.005f, 0.25f, "%.4f")) {
-					renderer->kernel.updateGPUProbes();
-					f_updateProbes();
-				}
+				ImGui::SliderFloat("##PROBE_RADIUS", &renderer->kernel.PROBE_RADIUS, 0.005f, 0.25f, "%.4f");
 			}
 
 			const char* items_b[] = { "Sun Intensity", "Wind", "Height", "Pressure", "Current Temperature", "Day Temperature", "Night Temperature", "Humidity", "Water Vapor", "Cloud Coverage", "Cloud Water Content", "Cloud Particle Radius", "Cloud Optical Thickness", "Ozone", "Albedo", "UV Index", "Net Radiation", "Solar Insolation", "Outgoing Longwave Radiation", "Reflected Shortwave Radiation", "SPH.Wind", "SPH.Pressure", "SPH.Temperature" };
 			ImGui::Text("Probe Color Mode");
-			if (ImGui::Combo("##render_probe_color_mode", &render_probe_color_mode, items_b, IM_ARRAYSIZE(items_b))) {
-				if (render_probe_color_mode < SPH) {
-					renderer->kernel.BVH_SPH = false;
-				}
-				else {
-					renderer->kernel.BVH_SPH = true;
-				}
-				renderer->kernel.updateGPUProbes();
-				f_updateProbes();
-			}
+			ImGui::Combo("##render_probe_color_mode", &render_probe_color_mode, items_b, IM_ARRAYSIZE(items_b));
 		}
 		ImGui::Checkbox("Render Particles", &render_particles);
 		if (render_particles) {
 			ImGui::Checkbox("Render Particle Lighting", &render_particle_lighting);
 			ImGui::Text("Particle Display Radius");
-			if (ImGui::SliderFloat("##PARTICLE_RADIUS", &renderer->kernel.PARTICLE_RADIUS, 0.005f, 0.25f, "%.4f")) {
-				renderer->kernel.updateGPUParticles();
-				f_updateParticles();
-			}
+			ImGui::SliderFloat("##PARTICLE_RADIUS", &renderer->kernel.PARTICLE_RADIUS, 0.005f, 0.25f, "%.4f");
 		}
 	}
 	ImGui::PopItemWidth();
 
 	if (ImGui::CollapsingHeader("VRAM Stats")) {
-		ImGui::Text(string("Octree VRAM: " + to_string((renderer->kernel.probe_nodes.size() * sizeof(GPU_Bvh)) / 1024) + "kb ").c_str());
+		ImGui::Text(string("Octree VRAM: " + to_string((renderer->simulation.snapshots.front().probe_nodes.size() * sizeof(GPU_Bvh)) / 1024) + "kb ").c_str());
 		ImGui::Text(string("Texture VRAM: " + to_string((texture_size * sizeof(uint)) / 1024 / 1024) + "mb ").c_str());
 		ImGui::Text(string("Particle VRAM: " + to_string((renderer->kernel.PROBE_COUNT * sizeof(GPU_Probe)) / 1024) + "kb ").c_str());
 	}
@@ -309,12 +306,11 @@ void PathTracer::f_cleanup() {
 	glDeleteProgram(gl_data["compute_program"]);
 	glDeleteProgram(gl_data["display_program"]);
 
-	glDeleteBuffers(1, &gl_data["ssbo 1"]);
-	glDeleteBuffers(1, &gl_data["ssbo 2"]);
-	glDeleteBuffers(1, &gl_data["ssbo 3"]);
-	glDeleteBuffers(1, &gl_data["ssbo 4"]);
 	glDeleteBuffers(1, &gl_data["ssbo 5"]);
 	glDeleteBuffers(1, &gl_data["ssbo 6"]);
+	for (auto& ring : ssbo_rings) {
+		ring.second.release();
+	}
 
 	glDeleteTextures(1, &gl_data["raw_render_layer"]);
 
@@ -346,6 +342,8 @@ void PathTracer::f_render() {
 	const vec3 projection_center = camera_pos + focal_length * z_vector;
 	const vec3 projection_u = normalize(cross(z_vector, y_vector)) * sensor_size;
 	const vec3 projection_v = normalize(cross(projection_u, z_vector)) * sensor_size;
+	const Kernel_Snapshot& snapshot = renderer->simulation.snapshots.front();
+	const mat3 earth_rotation = d_to_f(glm::mat3_cast(snapshot.earth_rotation));
 
 	//const mat4 matrix = d_to_f(glm::yawPitchRoll(renderer->camera_transform.euler_rotation.y * DEG_RAD, renderer->camera_transform.euler_rotation.x * DEG_RAD, renderer->camera_transform.euler_rotation.z * DEG_RAD));
 	//const vec3 y_vector = matrix[1];
@@ -365,9 +363,10 @@ void PathTracer::f_render() {
 	glUniform3fv (glGetUniformLocation(compute_program, "camera_p_uv"),1, value_ptr(projection_center));
 	glUniform3fv (glGetUniformLocation(compute_program, "camera_p_u"), 1, value_ptr(projection_u));
 	glUniform3fv (glGetUniformLocation(compute_program, "camera_p_v"), 1, value_ptr(projection_v));
-	glUniform1f  (glGetUniformLocation(compute_program, "earth_tilt"),d_to_f( renderer->kernel.EARTH_TILT));
-	glUniform1f  (glGetUniformLocation(compute_program, "year_time"), d_to_f(renderer->kernel.YEAR_TIME));
-	glUniform1f  (glGetUniformLocation(compute_program, "day_time"),  d_to_f(renderer->kernel.DAY_TIME));
+	glUniform1f  (glGetUniformLocation(compute_program, "earth_tilt"),d_to_f(snapshot.earth_tilt));
+	glUniform1f  (glGetUniformLocation(compute_program, "year_time"), d_to_f(snapshot.year_time));
+	glUniform1f  (glGetUniformLocation(compute_program, "day_time"),  d_to_f(snapshot.day_time));
+	glUniformMatrix3fv(glGetUniformLocation(compute_program, "earth_rotation"), 1, GL_FALSE, value_ptr(earth_rotation));
 	glUniform1ui (glGetUniformLocation(compute_program, "use_probe_octree"), use_probe_octree);
 	glUniform1ui (glGetUniformLocation(compute_program, "use_particle_octree"), use_particle_octree);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_planet"), render_planet);
@@ -377,25 +376,28 @@ void PathTracer::f_render() {
 	glUniform1ui (glGetUniformLocation(compute_program, "render_particle_lighting"), render_particle_lighting);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_atmosphere"), render_atmosphere);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_probe_octree"), render_probe_octree);
-	glUniform1ui (glGetUniformLocation(compute_program, "render_particle_octree"), render_particle_octree);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_octree_hue"), render_octree_hue);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_octree_debug"), render_octree_debug);
 	glUniform1i  (glGetUniformLocation(compute_program, "render_octree_debug_index"), render_octree_debug_index);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_probes"), render_probes);
 	glUniform1f  (glGetUniformLocation(compute_program, "render_probe_radius"), renderer->kernel.PROBE_RADIUS);
 	glUniform1i  (glGetUniformLocation(compute_program, "render_probe_color_mode"), render_probe_color_mode);
+	glUniform1f  (glGetUniformLocation(compute_program, "render_probe_bvh_padding"), render_probe_color_mode < SPH ? renderer->kernel.PROBE_RADIUS : snapshot.max_smoothing_radius);
 	glUniform1ui (glGetUniformLocation(compute_program, "render_particles"), render_particles);
 	glUniform1f  (glGetUniformLocation(compute_program, "render_particle_radius"), renderer->kernel.PARTICLE_RADIUS);
+	glUniform1f  (glGetUniformLocation(compute_program, "render_particle_bvh_padding"), snapshot.particle_probe_distance + renderer->blend_padding + renderer->kernel.PARTICLE_RADIUS);
 
 	glBindImageTexture(0, gl_data["raw_render_layer"], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gl_data["ssbo 1"]);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gl_data["ssbo 2"]);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, gl_data["ssbo 3"]);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, gl_data["ssbo 4"]);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, gl_data["ssbo 5"]);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, gl_data["ssbo 6"]);
+	for (const auto& ring : ssbo_rings) {
+		ring.second.bind(ring.first);
+	}
 
 	glDispatchCompute(compute_layout.x, compute_layout.y, 1);
+	for (auto& ring : ssbo_rings) {
+		ring.second.fence();
+	}
 
 	glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
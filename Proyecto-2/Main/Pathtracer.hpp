@@ -3,6 +3,8 @@
 #include "Shared.hpp"
 
 #include "OpenGL.hpp"
+#include "Kernel.hpp"
+#include "Simulation.hpp"
 
 #define SPH 20
 
@@ -12,6 +14,8 @@ struct PathTracer {
 	Renderer* renderer;
 
 	unordered_map<string, GLuint> gl_data;
+	unordered_map<GLuint, Ssbo_Ring> ssbo_rings; // Per binding, written every simulated frame
+	uint64 gpu_versions[GPU_BLOCKS]; // Kernel_Snapshot::versions last uploaded
 	uvec2 compute_layout;
 
 	vector<GPU_Texture> textures;
@@ -27,7 +31,6 @@ struct PathTracer {
 	bool render_probe_lighting;
 	bool render_particle_lighting;
 	bool render_probe_octree;
-	bool render_particle_octree;
 
 	bool render_atmosphere;
 	bool render_octree_hue;
@@ -40,8 +43,8 @@ struct PathTracer {
 
 	void f_initialize();
 
-	void f_updateProbes();
-	void f_updateParticles();
+	void f_updateSnapshot(const Kernel_Snapshot& snapshot, const uint& blended = 0);
+	void f_updateBlend(const Snapshot_Blend& blend);
 	void f_updateTextures(const bool& high_res);
 
 	void f_guiUpdate(const vec1& availableWidth, const vec1& spacing, const vec1& itemWidth, const vec1& halfWidth, const vec1& thirdWidth, const vec1& halfPos);
@@ -0,0 +1,221 @@
+#include "Simulation.hpp"
+
+Kernel_Settings::Kernel_Settings() :
+	TIME_SCALE(1.0),
+	MAX_SUB_SAMPLES(1),
+	COURANT(1.0),
+	THREAD_COUNT(1),
+	EXACT_THERMODYNAMICS(false),
+	COMPARE_PRECISION(false),
+	SEED(0)
+{}
+
+void Kernel_Settings::capture(const Kernel& kernel) {
+	TIME_SCALE = kernel.TIME_SCALE;
+	MAX_SUB_SAMPLES = kernel.MAX_SUB_SAMPLES;
+	COURANT = kernel.COURANT;
+	THREAD_COUNT = kernel.THREAD_COUNT;
+	EXACT_THERMODYNAMICS = kernel.EXACT_THERMODYNAMICS;
+	COMPARE_PRECISION = kernel.COMPARE_PRECISION;
+	SEED = kernel.SEED;
+}
+
+// Runs on whichever thread owns the kernel, between steps so no job is in flight when the pool is resized
+void Kernel_Settings::apply(Kernel& kernel) const {
+	kernel.TIME_SCALE = TIME_SCALE;
+	kernel.MAX_SUB_SAMPLES = MAX_SUB_SAMPLES;
+	kernel.COURANT = COURANT;
+	kernel.EXACT_THERMODYNAMICS = EXACT_THERMODYNAMICS;
+	kernel.SEED = SEED;
+	if (kernel.THREAD_COUNT != THREAD_COUNT) {
+		kernel.THREAD_COUNT = THREAD_COUNT;
+		JOBS.resize(THREAD_COUNT);
+	}
+	if (kernel.COMPARE_PRECISION != COMPARE_PRECISION) {
+		kernel.COMPARE_PRECISION = COMPARE_PRECISION;
+		kernel.resetComparison();
+	}
+}
+
+Simulation::Simulation(Kernel* kernel) :
+	kernel(kernel),
+	settings_changed(false),
+	running(false),
+	step_rate(30.0),
+	epoch(chrono::high_resolution_clock::now())
+{}
+
+Simulation::~Simulation() {
+	stop();
+}
+
+void Simulation::start() {
+	if (running.load()) {
+		return;
+	}
+	running.store(true);
+	worker = thread(&Simulation::loop, this);
+}
+
+void Simulation::stop() {
+	running.store(false);
+	if (worker.joinable()) {
+		worker.join();
+	}
+	applySettings();
+}
+
+// Never waits on a step: while running the change is picked up before the next one, stopped it is applied right away
+void Simulation::editSettings(const function<void(Kernel_Settings&)>& edit) {
+	{
+		const lock_guard<mutex> lock(settings_mutex);
+		edit(settings);
+	}
+	settings_changed.store(true);
+	if (!running.load()) {
+		applySettings();
+	}
+}
+
+void Simulation::applySettings() {
+	if (!settings_changed.exchange(false)) {
+		return;
+	}
+	Kernel_Settings pending;
+	{
+		const lock_guard<mutex> lock(settings_mutex);
+		pending = settings;
+	}
+	pending.apply(*kernel);
+}
+
+// Steps at step_rate and measures each step on this thread, so the simulated time follows the wall clock whatever the display rate.
+// A step that overruns its period delays the schedule instead of being followed by a burst of catch-up steps.
+void Simulation::loop() {
+	auto last_time = chrono::high_resolution_clock::now();
+	auto next_time = last_time;
+	while (running.load()) {
+		const auto period = chrono::duration_cast<chrono::high_resolution_clock::duration>(chrono::duration<double>(1.0 / step_rate.load()));
+		next_time += period;
+		this_thread::sleep_until(next_time);
+		const auto current_time = chrono::high_resolution_clock::now();
+		const dvec1 delta_time = chrono::duration<double>(current_time - last_time).count();
+		last_time = current_time;
+		if (current_time > next_time + period) {
+			next_time = current_time;
+		}
+		applySettings();
+		update();
+		step(delta_time);
+		publish();
+	}
+}
+
+void Simulation::step(const dvec1& delta_time) {
+	kernel->simulate(delta_time);
+}
+
+void Simulation::publish() {
+	kernel->snapshot(snapshots.back());
+	snapshots.back().time = clock();
+	snapshots.publish();
+}
+
+dvec1 Simulation::clock() const {
+	return chrono::duration<double>(chrono::high_resolution_clock::now() - epoch).count();
+}
+
+// Rebuilds what Kernel::invalidate marked stale, true if anything changed
+bool Simulation::update() {
+	const uint dirty = kernel->dirty;
+	kernel->dirty = 0;
+	if (dirty & KERNEL_PROBES) {
+		updateProbes();
+	}
+	else if (dirty & KERNEL_TIME) {
+		updateTime();
+	}
+	if (dirty & KERNEL_PARTICLES) {
+		updateParticles();
+	}
+	return dirty != 0;
+}
+
+void Simulation::updateProbes() {
+	kernel->buildProbes();
+	kernel->updateGPUProbes();
+	kernel->updateGPUParticles();
+}
+
+void Simulation::updateParticles() {
+	kernel->buildParticles();
+	kernel->updateGPUParticles();
+}
+
+void Simulation::updateTime() {
+	kernel->resampleTime();
+	kernel->updateGPUProbeStates();
+}
+
+Snapshot_Blend::Snapshot_Blend() {
+	probe_version = 0;
+	anchor_version = 0;
+	time = 0.0;
+	alpha = 1.0f;
+	max_offset = 0.0f;
+	fresh = false;
+}
+
+// Called with the current front snapshot right before the next one is consumed
+void Snapshot_Blend::capture(const Kernel_Snapshot& snapshot) {
+	probe_states = snapshot.probe_states;
+	particle_rotations = snapshot.particle_rotations;
+	probe_version = snapshot.versions[f_gpuBlock(GPU_PROBES)];
+	anchor_version = snapshot.versions[f_gpuBlock(GPU_PARTICLE_ANCHORS)];
+	this->time = snapshot.time;
+	alpha = 0.0f;
+}
+
+// False when the previous snapshot holds other probes or particles, the newest snapshot is then shown as is
+bool Snapshot_Blend::blend(const Kernel_Snapshot& snapshot, const dvec1& time) {
+	fresh = false;
+	if (probe_states.size() != snapshot.probe_states.size() or probe_version != snapshot.versions[f_gpuBlock(GPU_PROBES)]) {
+		return false;
+	}
+	if (particle_rotations.size() != snapshot.particle_rotations.size() or anchor_version != snapshot.versions[f_gpuBlock(GPU_PARTICLE_ANCHORS)]) {
+		return false;
+	}
+	if (alpha >= 1.0f and !blended_particles.empty()) {
+		return true;
+	}
+	const dvec1 span = snapshot.time - this->time;
+	alpha = span > 0.0 ? d_to_f(clamp((time - snapshot.time) / span, 0.0, 1.0)) : 1.0f;
+	fresh = true;
+
+	blended_states.resize(probe_states.size());
+	for (uint i = 0; i < len32(probe_states); i++) {
+		const GPU_Probe_State& a = probe_states[i];
+		const GPU_Probe_State& b = snapshot.probe_states[i];
+		GPU_Probe_State& state = blended_states[i];
+		state.wind_vector     = glm::mix(a.wind_vector, b.wind_vector, alpha);
+		state.sun_intensity   = glm::mix(a.sun_intensity, b.sun_intensity, alpha);
+		state.sph_wind_vector = glm::mix(a.sph_wind_vector, b.sph_wind_vector, alpha);
+		state.sph_temperature = glm::mix(a.sph_temperature, b.sph_temperature, alpha);
+		state.pressure        = glm::mix(a.pressure, b.pressure, alpha);
+		state.temperature     = glm::mix(a.temperature, b.temperature, alpha);
+		state.sph_pressure    = glm::mix(a.sph_pressure, b.sph_pressure, alpha);
+	}
+
+	// Slots follow the newest sort, so the particle ranges of the newest snapshot stay valid
+	// Particles are binned to probes at their newest position, a blended one may lie outside its padded leaf by up to max_offset
+	blended_particles.clear();
+	blended_particles.reserve(snapshot.particle_ids.size());
+	max_offset = 0.0f;
+	for (const uint& id : snapshot.particle_ids) {
+		const vec3& anchor = snapshot.particle_anchors[id];
+		const vec3 position = glm::slerp(particle_rotations[id], snapshot.particle_rotations[id], alpha) * anchor;
+		max_offset = max(max_offset, glm::distance(position, snapshot.particle_rotations[id] * anchor));
+		blended_particles.push_back(GPU_Particle(position));
+	}
+	return true;
+}
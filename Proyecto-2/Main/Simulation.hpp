@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Shared.hpp"
+#include "Threading.hpp"
+
+#include "Kernel.hpp"
+
+// Kernel settings that stay editable while playing. The GUI edits the copy in Simulation, which reaches the kernel between steps.
+struct Kernel_Settings {
+	dvec1  TIME_SCALE;
+	uint   MAX_SUB_SAMPLES;
+	dvec1  COURANT;
+	uint   THREAD_COUNT;
+	bool   EXACT_THERMODYNAMICS;
+	bool   COMPARE_PRECISION;
+	uint64 SEED;
+
+	Kernel_Settings();
+
+	void capture(const Kernel& kernel);
+	void apply(Kernel& kernel) const;
+};
+
+// Steps the kernel on its own thread while the simulation plays, every step is handed to the renderer as a Kernel_Snapshot.
+// While the thread runs it owns the kernel: settings go through editSettings, simulated values are read from the snapshot.
+// Stopped, the render thread updates the kernel and publishes the snapshots itself.
+struct Simulation {
+	Kernel* kernel;
+	Triple_Buffer<Kernel_Snapshot> snapshots;
+	Kernel_Settings settings; // Written by the render thread only, under settings_mutex
+	mutex           settings_mutex; // Held for a copy of settings, never across a step
+	atomic<bool>    settings_changed;
+
+	thread        worker;
+	atomic<bool>  running;
+	atomic<dvec1> step_rate; // Steps per second of wall time while running, the display is blended in between
+	chrono::high_resolution_clock::time_point epoch;
+
+	Simulation(Kernel* kernel = nullptr);
+	~Simulation();
+
+	void start();
+	void stop();
+	void editSettings(const function<void(Kernel_Settings&)>& edit);
+	void applySettings();
+	void loop();
+	void step(const dvec1& delta_time);
+	void publish();
+	dvec1 clock() const;
+
+	bool update();
+	void updateProbes();
+	void updateParticles();
+	void updateTime();
+};
+
+// Render side blend of the two newest snapshots: the display trails the simulation by one step and moves at display rate
+// whatever the step rate. Particles slerp their rotation, probe states are lerped, a rebuild in between snaps to the newest.
+struct Snapshot_Blend {
+	vector<GPU_Probe_State> probe_states; // Of the previous snapshot
+	vector<quat>            particle_rotations; // Of the previous snapshot, by id
+	uint64 probe_version;
+	uint64 anchor_version;
+	dvec1  time;
+
+	vector<GPU_Probe_State> blended_states;
+	vector<GPU_Particle>    blended_particles;
+	vec1 alpha; // Of the blended arrays, 1 once they reached the newest snapshot
+	vec1 max_offset; // Largest distance of a blended particle from its newest position, the particle BVH padding grows by it
+	bool fresh; // Blended arrays recomputed by the last blend
+
+	Snapshot_Blend();
+
+	void capture(const Kernel_Snapshot& snapshot);
+	bool blend(const Kernel_Snapshot& snapshot, const dvec1& time);
+};
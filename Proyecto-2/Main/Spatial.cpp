@@ -0,0 +1,187 @@
+#include "Spatial.hpp"
+
+Kd_Neighbor::Kd_Neighbor(const dvec1& distance, const uint& index) :
+	distance(distance),
+	index(index)
+{}
+
+bool Kd_Neighbor::operator<(const Kd_Neighbor& other) const {
+	return distance < other.distance;
+}
+
+Kd_Node::Kd_Node(const uint& start, const uint& end) :
+	start(start),
+	end(end),
+	left(KD_LEAF),
+	right(KD_LEAF),
+	axis(0),
+	split(0.0)
+{}
+
+Kd_Tree::Kd_Tree() :
+	leaf_size(8)
+{}
+
+Kd_Tree::Kd_Tree(const vector<dvec3>& points, const uint& leaf_size) {
+	build(points, leaf_size);
+}
+
+void Kd_Tree::build(const vector<dvec3>& points, const uint& leaf_size) {
+	this->points = points;
+	this->leaf_size = max(leaf_size, 1U);
+
+	indices.resize(points.size());
+	iota(indices.begin(), indices.end(), 0U);
+
+	nodes.clear();
+	nodes.reserve(2 * (points.size() / this->leaf_size + 1));
+	if (!points.empty()) {
+		buildNode(0, len32(indices));
+	}
+}
+
+uint Kd_Tree::buildNode(const uint& start, const uint& end) {
+	const uint node_index = len32(nodes);
+	nodes.push_back(Kd_Node(start, end));
+
+	if (end - start <= leaf_size) {
+		return node_index;
+	}
+
+	dvec3 p_min = dvec3(MAX_DVEC1);
+	dvec3 p_max = dvec3(-MAX_DVEC1);
+	for (uint i = start; i < end; i++) {
+		p_min = glm::min(p_min, points[indices[i]]);
+		p_max = glm::max(p_max, points[indices[i]]);
+	}
+	const dvec3 extent = p_max - p_min;
+	const uint axis = (extent.x > extent.y and extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+	const uint mid = start + (end - start) / 2;
+	nth_element(indices.begin() + start, indices.begin() + mid, indices.begin() + end, [&](const uint& a, const uint& b) {
+		return points[a][axis] < points[b][axis];
+	});
+	const dvec1 split = points[indices[mid]][axis];
+
+	const uint left = buildNode(start, mid);
+	const uint right = buildNode(mid, end);
+
+	Kd_Node& node = nodes[node_index];
+	node.axis = axis;
+	node.split = split;
+	node.left = left;
+	node.right = right;
+	return node_index;
+}
+
+void Kd_Tree::nearest(const dvec3& point, const uint& count, vector<Kd_Neighbor>& result, const uint& exclude) const {
+	result.clear();
+	if (nodes.empty() or count == 0) {
+		return;
+	}
+	result.reserve(count);
+	search(0, point, count, exclude, result);
+
+	sort_heap(result.begin(), result.end());
+	for (Kd_Neighbor& neighbor : result) {
+		neighbor.distance = sqrt(neighbor.distance);
+	}
+}
+
+Kd_Neighbor Kd_Tree::closest(const dvec3& point) const {
+	vector<Kd_Neighbor> result;
+	nearest(point, 1, result);
+	if (result.empty()) {
+		return Kd_Neighbor();
+	}
+	return result[0];
+}
+
+void Kd_Tree::search(const uint& node_index, const dvec3& point, const uint& count, const uint& exclude, vector<Kd_Neighbor>& heap) const {
+	const Kd_Node& node = nodes[node_index];
+
+	if (node.left == KD_LEAF) {
+		for (uint i = node.start; i < node.end; i++) {
+			const uint index = indices[i];
+			if (index == exclude) {
+				continue;
+			}
+			const dvec3 delta = points[index] - point;
+			const dvec1 distance = glm::dot(delta, delta);
+			if (heap.size() < count) {
+				heap.push_back(Kd_Neighbor(distance, index));
+				push_heap(heap.begin(), heap.end());
+			}
+			else if (distance < heap.front().distance) {
+				pop_heap(heap.begin(), heap.end());
+				heap.back() = Kd_Neighbor(distance, index);
+				push_heap(heap.begin(), heap.end());
+			}
+		}
+		return;
+	}
+
+	const dvec1 delta = point[node.axis] - node.split;
+	const uint near_child = delta < 0.0 ? node.left : node.right;
+	const uint far_child  = delta < 0.0 ? node.right : node.left;
+
+	search(near_child, point, count, exclude, heap);
+	if (heap.size() < count or delta * delta < heap.front().distance) {
+		search(far_child, point, count, exclude, heap);
+	}
+}
+
+dvec3 f_fibonacciPoint(const uint& index, const uint& count) {
+	const dvec1 cos_theta = count > 1 ? 1.0 - 2.0 * u_to_d(index) / u_to_d(count - 1) : 1.0;
+	const dvec1 sin_theta = sqrt(max(0.0, 1.0 - cos_theta * cos_theta));
+	const dvec1 phi = u_to_d(index) * (PI * (3.0 - sqrt(5.0)));
+	return dvec3(sin_theta * cos(phi), cos_theta, sin_theta * sin(phi));
+}
+
+uint f_inverseFibonacci(const dvec3& direction, const uint& count) {
+	if (count < 2) {
+		return 0;
+	}
+	const dvec1 dz = 2.0 / u_to_d(count - 1);
+	const dvec1 cos_theta = clamp(direction.y, -1.0, 1.0);
+	// The golden angle is 2PI * (2 - PHI), so the lattice longitude runs as -2PI * frac(i * (PHI - 1))
+	const dvec1 phi = -atan2(direction.z, direction.x);
+
+	// Pick the Fibonacci pair whose lattice vectors match the local point spacing
+	const dvec1 k = max(2.0, floor(log(u_to_d(count) * PI * sqrt(5.0) * (1.0 - cos_theta * cos_theta)) / log(PHI * PHI)));
+	const dvec1 fk = pow(PHI, k) / sqrt(5.0);
+	const dvec1 f0 = round(fk);
+	const dvec1 f1 = round(fk * PHI);
+
+	// Lattice basis: index offsets f0 and f1, longitude wrapped close to zero
+	const dvec2 b0 = dvec2(TWO_PI * (f0 * (PHI - 1.0) - floor((f0 + 1.0) * (PHI - 1.0))), -f0 * dz);
+	const dvec2 b1 = dvec2(TWO_PI * (f1 * (PHI - 1.0) - floor((f1 + 1.0) * (PHI - 1.0))), -f1 * dz);
+	const dvec1 det = b0.x * b1.y - b1.x * b0.y;
+	const dvec2 target = dvec2(phi, cos_theta - 1.0);
+	const dvec2 cell = dvec2(
+		floor(( b1.y * target.x - b1.x * target.y) / det),
+		floor((-b0.y * target.x + b0.x * target.y) / det)
+	);
+
+	// The closest lattice point is one of the four corners of the containing cell,
+	// or one of the two probes sitting exactly on the poles, which the lattice cells do not cover
+	uint candidates[6] = { 0, count - 1, 0, 0, 0, 0 };
+	for (uint s = 0; s < 4; s++) {
+		const dvec2 corner = cell + dvec2(s % 2, s / 2);
+		dvec1 z = 1.0 + corner.x * b0.y + corner.y * b1.y;
+		z = clamp(z, -1.0, 1.0) * 2.0 - z;
+		candidates[s + 2] = d_to_u(clamp(round((1.0 - z) / dz), 0.0, u_to_d(count - 1)));
+	}
+
+	uint closest = 0;
+	dvec1 closest_distance = MAX_DVEC1;
+	for (const uint& index : candidates) {
+		const dvec3 delta = f_fibonacciPoint(index, count) - direction;
+		const dvec1 distance = glm::dot(delta, delta);
+		if (distance < closest_distance) {
+			closest_distance = distance;
+			closest = index;
+		}
+	}
+	return closest;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Shared.hpp"
+
+#define KD_LEAF MAX_UINT32
+
+struct Kd_Neighbor {
+	dvec1 distance;
+	uint  index;
+
+	Kd_Neighbor(const dvec1& distance = MAX_DVEC1, const uint& index = KD_LEAF);
+
+	bool operator<(const Kd_Neighbor& other) const;
+};
+
+struct Kd_Node {
+	uint  start;
+	uint  end;
+	uint  left;
+	uint  right;
+	uint  axis;
+	dvec1 split;
+
+	Kd_Node(const uint& start, const uint& end);
+};
+
+// Static k-d tree over a point cloud, median split with nth_element, queried with a bounded max-heap
+struct Kd_Tree {
+	vector<dvec3>   points;
+	vector<uint>    indices;
+	vector<Kd_Node> nodes;
+	uint leaf_size;
+
+	Kd_Tree();
+	Kd_Tree(const vector<dvec3>& points, const uint& leaf_size = 8);
+
+	void build(const vector<dvec3>& points, const uint& leaf_size = 8);
+	uint buildNode(const uint& start, const uint& end);
+
+	// Closest `count` points sorted by distance, `exclude` skips a point index (itself)
+	void nearest(const dvec3& point, const uint& count, vector<Kd_Neighbor>& result, const uint& exclude = KD_LEAF) const;
+	Kd_Neighbor closest(const dvec3& point) const;
+
+	void search(const uint& node_index, const dvec3& point, const uint& count, const uint& exclude, vector<Kd_Neighbor>& heap) const;
+};
+
+// Spherical Fibonacci lattice as laid out by Kernel::buildProbes with no pole bias: y = 1 - 2i / (count - 1), phi = i * golden angle
+dvec3 f_fibonacciPoint(const uint& index, const uint& count);
+// Closed-form nearest lattice index to a unit direction [Keinert et al. 2015, Spherical Fibonacci Mapping]
+uint  f_inverseFibonacci(const dvec3& direction, const uint& count);
\ No newline at end of file
@@ -9,13 +9,9 @@
 Renderer::Renderer() {
 	window = nullptr;
 	kernel = Kernel();
+	simulation.kernel = &kernel;
+	simulation.settings.capture(kernel);
 	pathtracer = PathTracer(this);
-	if (pathtracer.render_probe_color_mode < SPH) {
-		kernel.BVH_SPH = false;
-	}
-	else {
-		kernel.BVH_SPH = true;
-	}
 
 	camera_transform = Transform(dvec3(0, 0, 37.5), dvec3(0));
 	world_rot = dquat(1,0,0,0);
@@ -54,12 +50,14 @@ Renderer::Renderer() {
 	last_time = current_time;
 
 	run_sim = false;
+	blend_snapshots = true;
+	blend_padding = 0.0f;
 	next_frame = false;
 	lock_settings = false;
 	lock_view = false;
 	
 	INIT_TIMER("Probe BVH")
-	INIT_TIMER("Particle BVH")
+	INIT_TIMER("Particle Sort")
 	INIT_TIMER("Particle Update")
 	INIT_TIMER("Scatter")
 	INIT_TIMER("Gather")
@@ -71,6 +69,7 @@ Renderer::Renderer() {
 }
 
 Renderer::~Renderer() {
+	simulation.stop();
 	pathtracer.f_cleanup();
 
 	ImGui_ImplOpenGL3_Shutdown();
@@ -195,45 +194,53 @@ void Renderer::systemInfo() {
 
 void Renderer::f_pipeline() {
 	pathtracer.f_initialize();
-	f_updateProbes();
-	f_updateParticles();
+	simulation.updateProbes();
+	simulation.updateParticles();
+	simulation.publish();
 }
 
+// While playing the simulation thread steps and publishes on its own, the frame only takes the newest snapshot
+// and blends it with the previous one for the current display time
 void Renderer::f_tickUpdate() {
+	TIMER("Transfer") = 0.0;
 	TIMER("Probe BVH") = 0.0;
-	TIMER("Particle BVH") = 0.0;
+	TIMER("Particle Sort") = 0.0;
 	TIMER("Scatter") = 0.0;
 	TIMER("Gather") = 0.0;
 	TIMER("Particle Update") = 0.0;
-	TIMER("Transfer") = 0.0;
-	if (run_sim or next_frame) {
+	if (!simulation.running.load()) {
+		bool changed = simulation.update();
 		if (next_frame) {
-			kernel.simulate(FPS_60);
+			simulation.step(FPS_60);
+			changed = true;
+			next_frame = false;
 		}
-		else {
-			kernel.simulate(delta_time);
+		if (changed) {
+			simulation.publish();
 		}
-
-		//kernel.buildProbes();
-		//kernel.buildParticles();
-
-		pathtracer.f_updateProbes();
-		pathtracer.f_updateParticles();
-
-		next_frame = false;
 	}
-}
-
-void Renderer::f_updateProbes() {
-	kernel.buildProbes();
-	kernel.updateGPUProbes();
-	pathtracer.f_updateProbes();
-}
-
-void Renderer::f_updateParticles() {
-	kernel.buildParticles();
-	kernel.updateGPUParticles();
-	pathtracer.f_updateParticles();
+	if (simulation.snapshots.ready()) {
+		snapshot_blend.capture(simulation.snapshots.front());
+		simulation.snapshots.consume();
+
+		// Kernel timers are only written by the stepping thread, the frame reads what they added since the last consumed snapshot
+		const Kernel_Timings& timings = simulation.snapshots.front().timings;
+		TIMER("Probe BVH") = timings.probe_bvh - consumed_timings.probe_bvh;
+		TIMER("Particle Sort") = timings.particle_sort - consumed_timings.particle_sort;
+		TIMER("Scatter") = timings.scatter - consumed_timings.scatter;
+		TIMER("Gather") = timings.gather - consumed_timings.gather;
+		TIMER("Particle Update") = timings.particle_update - consumed_timings.particle_update;
+		consumed_timings = timings;
+	}
+	const Kernel_Snapshot& snapshot = simulation.snapshots.front();
+	uint blended = 0;
+	blend_padding = 0.0f;
+	if (blend_snapshots and simulation.running.load() and snapshot_blend.blend(snapshot, simulation.clock())) {
+		pathtracer.f_updateBlend(snapshot_blend);
+		blended = GPU_PROBE_STATES | GPU_PARTICLES;
+		blend_padding = snapshot_blend.max_offset;
+	}
+	pathtracer.f_updateSnapshot(snapshot, blended);
 }
 
 void Renderer::f_guiLoop() {
@@ -261,21 +268,68 @@ void Renderer::f_guiLoop() {
 	ImGui::PushItemWidth(itemWidth);
 	ImGui::SeparatorText("Sampling Settings");
 	ImGui::Text("Time Scale");
-	float TIME_SCALE = d_to_f(kernel.TIME_SCALE);
+	// Settings are edited on the simulation copy, a running step picks them up before the next one without the frame waiting on it
+	const Kernel_Settings& settings = simulation.settings;
+	float TIME_SCALE = d_to_f(settings.TIME_SCALE);
 	if (ImGui::SliderFloat("##time_scale", &TIME_SCALE, 0.01f, 3650.0f, "%.3f")) {
-		kernel.TIME_SCALE = f_to_d(TIME_SCALE);
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.TIME_SCALE = f_to_d(TIME_SCALE); });
 	}
 
-	int SAMPLES = kernel.SUB_SAMPLES;
-	ImGui::Text("Sub Samples");
-	if (ImGui::SliderInt("##samples", &SAMPLES, 1, 50)) {
-		kernel.SUB_SAMPLES = SAMPLES;
+	// Substeps are picked every step by the stability controller, only its cap and safety factor are settings
+	int MAX_SAMPLES = u_to_i(settings.MAX_SUB_SAMPLES);
+	ImGui::Text("Max Sub Samples");
+	if (ImGui::SliderInt("##max_samples", &MAX_SAMPLES, 1, 1000)) {
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.MAX_SUB_SAMPLES = i_to_u(MAX_SAMPLES); });
+	}
+	float COURANT = d_to_f(settings.COURANT);
+	ImGui::Text("Courant Number");
+	if (ImGui::SliderFloat("##courant", &COURANT, 0.05f, 1.0f, "%.2f")) {
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.COURANT = f_to_d(COURANT); });
+	}
+	const Step_Control& control = simulation.snapshots.front().step_control;
+	ImGui::Text(("Sub Samples:  " + to_str(control.sub_samples, 0) + (control.capped ? " (capped)" : "")).c_str());
+	ImGui::Text(("Stable Step:  " + (control.stable_dt < MAX_DVEC1 ? to_str(control.stable_dt, 4) : string("unbounded"))).c_str());
+
+	int THREADS = u_to_i(settings.THREAD_COUNT);
+	ImGui::Text("Threads");
+	if (ImGui::SliderInt("##threads", &THREADS, 1, max(1, u_to_i(thread::hardware_concurrency())))) {
+		// The pool is resized where the settings are applied, between steps
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.THREAD_COUNT = i_to_u(THREADS); });
+	}
+	float STEP_RATE = d_to_f(simulation.step_rate.load());
+	ImGui::Text("Step Rate");
+	if (ImGui::SliderFloat("##step_rate", &STEP_RATE, 1.0f, 240.0f, "%.0f Hz")) {
+		simulation.step_rate.store(f_to_d(STEP_RATE));
+	}
+	ImGui::Checkbox("Blend Steps", &blend_snapshots);
+	bool EXACT_THERMODYNAMICS = settings.EXACT_THERMODYNAMICS;
+	if (ImGui::Checkbox("Exact Thermodynamics", &EXACT_THERMODYNAMICS)) {
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.EXACT_THERMODYNAMICS = EXACT_THERMODYNAMICS; });
+	}
+	bool COMPARE_PRECISION = settings.COMPARE_PRECISION;
+	if (ImGui::Checkbox("Compare FP32", &COMPARE_PRECISION)) {
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.COMPARE_PRECISION = COMPARE_PRECISION; });
+	}
+	if (settings.COMPARE_PRECISION) {
+		const Precision_Report& report = simulation.snapshots.front().precision_report;
+		ImGui::Text(("Substeps:     " + to_str(report.substeps, 0)).c_str());
+		ImGui::Text(("Temperature:  " + to_str(report.temperature, 6) + " K").c_str());
+		ImGui::Text(("Pressure:     " + to_str(report.pressure, 6) + " hPa").c_str());
+		ImGui::Text(("Wind:         " + to_str(report.wind, 6) + " m/s").c_str());
+		ImGui::Text(("Max Relative: " + to_str(report.relative * 100.0, 6) + " %").c_str());
+	}
+
+	int SEED = static_cast<int>(settings.SEED);
+	ImGui::Text("Seed");
+	if (ImGui::InputInt("##seed", &SEED)) {
+		simulation.editSettings([&](Kernel_Settings& edit) { edit.SEED = static_cast<uint64>(SEED); });
 	}
 	ImGui::PopItemWidth();
 
 	ImGui::SeparatorText("Play / Pause");
 	if (run_sim) {
 		if (ImGui::Button("Pause", ImVec2(itemWidth, 0))) {
+			simulation.stop();
 			run_sim = false;
 			lock_view = false;
 		}
@@ -283,6 +337,7 @@ void Renderer::f_guiLoop() {
 	else {
 		if (lock_settings) {
 			if (ImGui::Button("Play", ImVec2(halfWidth, 0))) {
+				simulation.start();
 				run_sim = true;
 				lock_view = true;
 			}
@@ -294,10 +349,11 @@ void Renderer::f_guiLoop() {
 		}
 		if (ImGui::Button("Lock Settings", ImVec2(itemWidth, 0))) {
 			lock_settings = true;
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_PROBES | KERNEL_PARTICLES);
+			simulation.update();
 			kernel.lock();
 			kernel.simulate(0.00001);
+			simulation.publish();
 		}
 
 		if (ImGui::CollapsingHeader("Probe Settings")) {
@@ -306,7 +362,14 @@ void Renderer::f_guiLoop() {
 			ImGui::Text("Probe Count");
 			if (ImGui::SliderInt("##PROBE_COUNT", &PROBE_COUNT, 128, 8192 * 4)) {
 				kernel.PROBE_COUNT = i_to_u(PROBE_COUNT);
-				f_updateProbes();
+				kernel.invalidate(KERNEL_PROBES);
+			}
+			int PROBE_NEIGHBORS = u_to_i(kernel.PROBE_NEIGHBORS);
+			ImGui::Text("Neighbors");
+			if (ImGui::SliderInt("##PROBE_NEIGHBORS", &PROBE_NEIGHBORS, 1, 32)) {
+				// The neighbor graph is only built by Kernel::lock, so Play waits for a new Lock Settings
+				kernel.PROBE_NEIGHBORS = i_to_u(PROBE_NEIGHBORS);
+				lock_settings = false;
 			}
 			ImGui::PopItemWidth();
 			ImGui::SeparatorText("Earth Settings");
@@ -319,13 +382,13 @@ void Renderer::f_guiLoop() {
 			float lon = d_to_f(kernel.PROBE_POLE_GEOLOCATION.x);
 			if (ImGui::SliderFloat("##PROBE_POLE_GEOLOCATION_x", &lon, -90.0f, 90.0f, "%.4f")) {
 				kernel.PROBE_POLE_GEOLOCATION.x = f_to_d(lon);
-				f_updateProbes();
+				kernel.invalidate(KERNEL_PROBES);
 			}
 			ImGui::SameLine();
 			float lat = d_to_f(kernel.PROBE_POLE_GEOLOCATION.y);
 			if (ImGui::SliderFloat("##PROBE_POLE_GEOLOCATION_y", &lat, -180.0f, 180.0f, "%.4f")) {
 				kernel.PROBE_POLE_GEOLOCATION.y = f_to_d(lat);
-				f_updateProbes();
+				kernel.invalidate(KERNEL_PROBES);
 			}
 
 			ImGui::Text("Pole Bias");
@@ -335,13 +398,13 @@ void Renderer::f_guiLoop() {
 			float pole_bias = d_to_f(kernel.PROBE_POLE_BIAS);
 			if (ImGui::SliderFloat("##PROBE_POLE_BIAS", &pole_bias, 0.0f, 1.0f, "%.5f")) {
 				kernel.PROBE_POLE_BIAS = f_to_d(pole_bias);
-				f_updateProbes();
+				kernel.invalidate(KERNEL_PROBES);
 			}
 			ImGui::SameLine();
 			float pole_power = d_to_f(kernel.PROBE_POLE_BIAS_POWER);
 			if (ImGui::SliderFloat("##PROBE_POLE_BIAS_POWER", &pole_power, 1.0f, 10.0f)) {
 				kernel.PROBE_POLE_BIAS_POWER = f_to_d(pole_power);
-				f_updateProbes();
+				kernel.invalidate(KERNEL_PROBES);
 			}
 		}
 		if (ImGui::CollapsingHeader("Particle Settings")) {
@@ -350,7 +413,7 @@ void Renderer::f_guiLoop() {
 			ImGui::Text("Particle Count");
 			if (ImGui::SliderInt("##PARTICLE_COUNT", &PARTICLE_COUNT, 128, 8192 * 4)) {
 				kernel.PARTICLE_COUNT = i_to_u(PARTICLE_COUNT);
-				f_updateParticles();
+				kernel.invalidate(KERNEL_PARTICLES);
 			}
 			ImGui::PopItemWidth();
 			ImGui::SeparatorText("Earth Settings");
@@ -363,13 +426,13 @@ void Renderer::f_guiLoop() {
 			float lon = d_to_f(kernel.PARTICLE_POLE_GEOLOCATION.x);
 			if (ImGui::SliderFloat("##PARTICLE_POLE_GEOLOCATION_x", &lon, -90.0f, 90.0f, "%.4f")) {
 				kernel.PARTICLE_POLE_GEOLOCATION.x = f_to_d(lon);
-				f_updateParticles();
+				kernel.invalidate(KERNEL_PARTICLES);
 			}
 			ImGui::SameLine();
 			float lat = d_to_f(kernel.PARTICLE_POLE_GEOLOCATION.y);
 			if (ImGui::SliderFloat("##PARTICLE_POLE_GEOLOCATION_y", &lat, -180.0f, 180.0f, "%.4f")) {
 				kernel.PARTICLE_POLE_GEOLOCATION.y = f_to_d(lat);
-				f_updateParticles();
+				kernel.invalidate(KERNEL_PARTICLES);
 			}
 
 			ImGui::Text("Pole Bias");
@@ -379,13 +442,13 @@ void Renderer::f_guiLoop() {
 			float pole_bias = d_to_f(kernel.PARTICLE_POLE_BIAS);
 			if (ImGui::SliderFloat("##PARTICLE_POLE_BIAS", &pole_bias, 0.0f, 1.0f, "%.5f")) {
 				kernel.PARTICLE_POLE_BIAS = f_to_d(pole_bias);
-				f_updateParticles();
+				kernel.invalidate(KERNEL_PARTICLES);
 			}
 			ImGui::SameLine();
 			float pole_power = d_to_f(kernel.PARTICLE_POLE_BIAS_POWER);
 			if (ImGui::SliderFloat("##PARTICLE_POLE_BIAS_POWER", &pole_power, 1.0f, 10.0f)) {
 				kernel.PARTICLE_POLE_BIAS_POWER = f_to_d(pole_power);
-				f_updateParticles();
+				kernel.invalidate(KERNEL_PARTICLES);
 			}
 		}
 
@@ -395,8 +458,7 @@ void Renderer::f_guiLoop() {
 		float tilt = d_to_f(kernel.EARTH_TILT);
 		if (ImGui::SliderFloat("##EARTH_TILT", &tilt, -89.0f, 89.0f, "%.2f")) {
 			kernel.EARTH_TILT = f_to_d(tilt);
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_TIME);
 		}
 		ImGui::PopItemWidth();
 		ImGui::PushItemWidth(halfWidth);
@@ -406,14 +468,12 @@ void Renderer::f_guiLoop() {
 		ImGui::Text("Day");
 		if (ImGui::SliderInt("##CALENDAR_MONTH", &kernel.CALENDAR_MONTH, 0, 12)) {
 			kernel.calculateDateTime();
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_TIME);
 		}
 		ImGui::SameLine();
 		if (ImGui::SliderInt("##CALENDAR_DAY", &kernel.CALENDAR_DAY, 0, 31)) {
 			kernel.calculateDateTime();
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_TIME);
 		}
 
 		ImGui::Text("Hour");
@@ -422,28 +482,27 @@ void Renderer::f_guiLoop() {
 		ImGui::Text("Minute");
 		if (ImGui::SliderInt("##CALENDAR_HOUR", &kernel.CALENDAR_HOUR, 0, 24)) {
 			kernel.calculateDateTime();
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_TIME);
 		}
 		ImGui::SameLine();
 		if (ImGui::SliderInt("##CALENDAR_MINUTE", &kernel.CALENDAR_MINUTE, 0, 60)) {
 			kernel.calculateDateTime();
-			f_updateProbes();
-			f_updateParticles();
+			kernel.invalidate(KERNEL_TIME);
 		}
 
 		ImGui::PopItemWidth();
 	}
 	if (ImGui::CollapsingHeader("Info")) {
+		const ivec4& calendar = simulation.snapshots.front().calendar;
 		ImGui::PushItemWidth(halfWidth);
-		ImGui::Text(("Month:  " + to_str(kernel.CALENDAR_MONTH, 0)).c_str());
+		ImGui::Text(("Month:  " + to_str(calendar.x, 0)).c_str());
 		ImGui::SameLine();
 		ImGui::SetCursorPosX(halfPos);
-		ImGui::Text(("Day:    " + to_str(kernel.CALENDAR_DAY, 0)).c_str());
-		ImGui::Text(("Hour:   " + to_str(kernel.CALENDAR_HOUR, 0)).c_str());
+		ImGui::Text(("Day:    " + to_str(calendar.y, 0)).c_str());
+		ImGui::Text(("Hour:   " + to_str(calendar.z, 0)).c_str());
 		ImGui::SameLine();
 		ImGui::SetCursorPosX(halfPos);
-		ImGui::Text(("Minute: " + to_str(kernel.CALENDAR_MINUTE, 0)).c_str());
+		ImGui::Text(("Minute: " + to_str(calendar.w, 0)).c_str());
 		ImGui::Text(("Zoom:   " + to_str(camera_zoom_sensitivity, 1)).c_str());
 		ImGui::SameLine();
 		ImGui::SetCursorPosX(halfPos);
@@ -484,7 +543,7 @@ void Renderer::f_guiLoop() {
 		END_TIMER("GUI Loop");
 		{
 			const dvec1 probe = TIMER_MARK("Probe BVH");
-			const dvec1 particle = TIMER_MARK("Particle BVH");
+			const dvec1 particle = TIMER_MARK("Particle Sort");
 			const dvec1 scatter = TIMER_MARK("Scatter");
 			const dvec1 gather = TIMER_MARK("Gather");
 			const dvec1 particle_update = TIMER_MARK("Particle Update");
@@ -534,7 +593,7 @@ void Renderer::f_guiLoop() {
 			ImGui::SetCursorPosX(thirdPos * 2.0f);
 			ImGui::Text((to_str(d_to_f(probe / frame_count * 1000.0), 2) + " ms").c_str());
 
-			ImGui::Text("Particle BVH");
+			ImGui::Text("Particle Sort");
 			ImGui::SameLine();
 			ImGui::SetCursorPosX(thirdPos);
 			ImGui::Text((to_str(d_to_f(particle * 1000.0), 2) + " ms").c_str());
@@ -601,7 +660,7 @@ void Renderer::f_frameUpdate() {
 	TIMER("Delta") = gpu_delta + abs(delta_time - gpu_delta);
 
 	UPDATE_TIMER_MARK("Probe BVH");
-	UPDATE_TIMER_MARK("Particle BVH");
+	UPDATE_TIMER_MARK("Particle Sort");
 	UPDATE_TIMER_MARK("Scatter");
 	UPDATE_TIMER_MARK("Gather");
 	UPDATE_TIMER_MARK("Particle Update");
@@ -612,7 +671,7 @@ void Renderer::f_frameUpdate() {
 	UPDATE_TIMER_MARK("Transfer");
 	if (window_time > 1.0) {
 		RESET_TIMER_MARK("Probe BVH");
-		RESET_TIMER_MARK("Particle BVH");
+		RESET_TIMER_MARK("Particle Sort");
 		RESET_TIMER_MARK("Scatter");
 		RESET_TIMER_MARK("Gather");
 		RESET_TIMER_MARK("Particle Update");
@@ -637,7 +696,7 @@ void Renderer::f_inputLoop() {
 	if (lock_view) {
 		const dmat4 rotmat = glm::rotate(dmat4(1.0), -glm::radians(kernel.EARTH_TILT), dvec3(0, 0, 1));
 		const dvec3 tilt = glm::normalize(dvec3(rotmat * dvec4(0,1,0,1)));
-		world_rot = glm::rotate(world_rot, glm::radians(delta_time * kernel.TIME_SCALE * 0.01 * 360.0), tilt);
+		world_rot = glm::rotate(world_rot, glm::radians(delta_time * simulation.settings.TIME_SCALE * 0.01 * 360.0), tilt);
 	}
 	camera = world_rot * dquat(camera_transform.euler_rotation);
 	for (uint i = 0; i < 6; i++) {
@@ -742,10 +801,10 @@ void Renderer::key(GLFWwindow* window, int key, int scancode, int action, int mo
 		instance->lock_view = !instance->lock_view;
 	}
 	if (key == GLFW_KEY_RIGHT && action == GLFW_PRESS) {
-		instance->kernel.TIME_SCALE /= 0.9;
+		instance->simulation.editSettings([](Kernel_Settings& edit) { edit.TIME_SCALE /= 0.9; });
 	}
 	if (key == GLFW_KEY_LEFT && action == GLFW_PRESS) {
-		instance->kernel.TIME_SCALE *= 0.9;
+		instance->simulation.editSettings([](Kernel_Settings& edit) { edit.TIME_SCALE *= 0.9; });
 	}
 	if (key == GLFW_KEY_PERIOD && action == GLFW_PRESS) {
 		instance->camera_orbit_sensitivity /= 0.9;
@@ -11,10 +11,15 @@
 #include "Kernel.hpp"
 
 #include "PathTracer.hpp"
+#include "Simulation.hpp"
 
 struct Renderer {
 	GLFWwindow* window;
 	Kernel kernel;
+	Simulation simulation;
+	Snapshot_Blend snapshot_blend;
+	Kernel_Timings consumed_timings; // Of the last consumed snapshot
+	vec1 blend_padding; // Snapshot_Blend::max_offset while blending, 0 otherwise
 
 	PathTracer pathtracer;
 
@@ -56,6 +61,7 @@ struct Renderer {
 	chrono::high_resolution_clock::time_point last_time;
 
 	bool  run_sim;
+	bool  blend_snapshots;
 	bool  next_frame;
 	bool  lock_settings;
 	bool  lock_view;
@@ -75,9 +81,6 @@ struct Renderer {
 	void f_inputLoop();
 	void f_timings();
 
-	void f_updateProbes();
-	void f_updateParticles();
-
 	void f_guiLoop();
 	void f_displayLoop();
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <condition_variable>
 #include <unordered_map>
 #include <unordered_set>
 #include <type_traits>
@@ -18,11 +19,15 @@
 #include <cerrno>
 #include <chrono>
 #include <future>
+#include <memory>
 #include <random>
 #include <string>
 #include <thread>
+#include <mutex>
 #include <vector>
+#include <atomic>
 #include <array>
+#include <deque>
 #include <regex>
 #include <tuple>
 #include <any>
@@ -37,6 +37,28 @@ struct alignas(16) GPU_Texture {
 	);
 };
 
+#define SSBO_RING_REGIONS 3
+
+// Persistently mapped SSBO split in SSBO_RING_REGIONS regions, the CPU writes the next region while the GPU still reads the previous ones.
+// Every region is fenced after the draw that reads it and waited on before it is written again, storage is only reallocated on growth.
+struct Ssbo_Ring {
+	GLuint     buffer;
+	GLsizeiptr capacity; // Bytes per region, a multiple of the offset alignment
+	GLsizeiptr size; // Bytes written to the current region
+	uint       region;
+	char*      mapped;
+	GLsync     fences[SSBO_RING_REGIONS];
+
+	Ssbo_Ring();
+
+	void write(const void* data, const GLsizeiptr& size);
+	void bind(const GLuint& binding) const;
+	void fence();
+	void release();
+	void reserve(const GLsizeiptr& size);
+	void waitRegion(const uint& index);
+};
+
 Confirm<GLuint> fragmentShaderProgram(const string& vert_file_path, const string& frag_file_path);
 Confirm<GLuint> computeShaderProgram(const string& file_path);
 GLuint renderLayer(const uvec2& resolution);
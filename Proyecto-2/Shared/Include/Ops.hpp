@@ -30,6 +30,11 @@ vec1  randF();
 dvec1 randD(const dvec1& min, const dvec1& max);
 vec1  randF(const vec1& min, const vec1& max);
 vec1  randF(const dvec1& min, const dvec1& max);
+// Counter based generator [Widynski 2020, Squares: A Fast Counter-Based RNG], stateless so every draw is a pure function
+// of (seed, entity, step, draw): lock free from any thread and identical for any thread count
+uint64 f_squares64(const uint64& counter, const uint64& key);
+uint64 f_rngKey(const uint64& seed, const uint64& step);
+dvec1  f_randD(const uint64& seed, const uint& entity, const uint64& step, const uint& draw = 0);
 bool  insideAABB(const vec3& point, vec3& p_min, const vec3& p_max);
 dvec1 easeInOut(const dvec1& t);
 
@@ -350,6 +355,40 @@ struct Confirm {
 	}
 };
 
+template <typename T, uint64 Alignment = 64>
+struct Aligned_Allocator {
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind {
+		typedef Aligned_Allocator<U, Alignment> other;
+	};
+
+	Aligned_Allocator() = default;
+	template <typename U>
+	Aligned_Allocator(const Aligned_Allocator<U, Alignment>&) {}
+
+	T* allocate(const uint64 count) {
+		void* pointer = _aligned_malloc(count * sizeof(T), Alignment);
+		if (!pointer) {
+			throw bad_alloc();
+		}
+		return static_cast<T*>(pointer);
+	}
+	void deallocate(T* pointer, const uint64 count) {
+		_aligned_free(pointer);
+	}
+
+	template <typename U>
+	bool operator==(const Aligned_Allocator<U, Alignment>&) const { return true; }
+	template <typename U>
+	bool operator!=(const Aligned_Allocator<U, Alignment>&) const { return false; }
+};
+
+// Contiguous, cache-line aligned storage for structure-of-arrays data
+template <typename T>
+using Aligned_Array = vector<T, Aligned_Allocator<T>>;
+
 template <typename T>
 T f_expLerp(const T& current, const T& target, const uint& decay = 16, const dvec1& delta_time = FPS_60) { // from 1 - 25
 	return target + (current - target) * exp(-static_cast<int>(decay) * delta_time);
@@ -4,4 +4,5 @@
 
 #include "Session.hpp"
 #include "Lace.hpp"
-#include "Ops.hpp"
\ No newline at end of file
+#include "Ops.hpp"
+#include "Threading.hpp"
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Include.hpp"
+
+// Set in Triple_Buffer::middle while the slot it holds has not been consumed yet
+#define TRIPLE_BUFFER_FRESH 0x4U
+
+// Single writer / single reader handoff of the newest complete value, neither side ever waits on the other.
+// The writer fills back() and publishes it, the reader swaps in the newest published slot with consume() and reads front().
+// A value published twice before the reader consumes is skipped, the slot then comes back to the writer as is.
+template <typename T>
+struct Triple_Buffer {
+	T slots[3];
+	atomic<uint> middle; // Slot index | TRIPLE_BUFFER_FRESH
+	uint back_index;
+	uint front_index;
+
+	Triple_Buffer() :
+		middle(1U),
+		back_index(0U),
+		front_index(2U)
+	{}
+
+	T& back() {
+		return slots[back_index];
+	}
+	const T& front() const {
+		return slots[front_index];
+	}
+
+	bool ready() const {
+		return (middle.load(memory_order_acquire) & TRIPLE_BUFFER_FRESH) != 0;
+	}
+	void publish() {
+		back_index = middle.exchange(back_index | TRIPLE_BUFFER_FRESH, memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+	}
+	bool consume() {
+		if (!ready()) {
+			return false;
+		}
+		front_index = middle.exchange(front_index, memory_order_acq_rel) & ~TRIPLE_BUFFER_FRESH;
+		return true;
+	}
+};
+
+// Work-stealing pool the kernel stages, BVH builders and asset loading run on.
+// Every worker owns a deque, it runs its own jobs newest first from the back and steals the oldest from the front of the others.
+// Jobs pushed from outside the pool go round robin, and a thread waiting on a Task_Group runs queued jobs instead of sleeping,
+// so a parallel loop started inside a job cannot starve the pool.
+struct Job_System {
+	static Job_System& getInstance();
+
+	Job_System();
+	~Job_System();
+
+	Job_System(const Job_System&) = delete;
+	Job_System& operator=(const Job_System&) = delete;
+
+	struct Job_Queue {
+		mutex lock;
+		deque<function<void()>> jobs;
+	};
+
+	vector<unique_ptr<Job_Queue>> queues; // One per worker
+	vector<thread> workers;
+	mutex sleep_mutex;
+	condition_variable wake;
+	atomic<uint> queued;
+	atomic<uint> next_queue;
+	atomic<bool> stopping;
+	uint thread_count;
+
+	// Threads a loop spreads over, the waiting caller makes up the last one. At 1 loops and groups run inline on the caller,
+	// the single worker is then only there for f_async. Only while no job is in flight.
+	void resize(const uint& thread_count);
+	uint size() const;
+	void submit(function<void()> job);
+	bool runOne(); // Runs one queued job on the calling thread, false when every queue is empty
+	bool pop(const uint& worker, function<void()>& job);
+	void work(const uint& worker);
+	void stop();
+};
+
+#define JOBS Job_System::getInstance()
+
+// Jobs that are waited on together, the waiting thread helps run them. With a pool of size 1 they run inline in run.
+struct Task_Group {
+	atomic<uint> pending;
+
+	Task_Group();
+	~Task_Group();
+
+	Task_Group(const Task_Group&) = delete;
+	Task_Group& operator=(const Task_Group&) = delete;
+
+	void run(function<void()> job);
+	void wait();
+};
+
+// Calls body(i) for every i in [start, end), split in a few chunks per thread so stealing evens out uneven iterations
+template <typename F>
+void f_parallelFor(const uint& start, const uint& end, const F& body) {
+	if (end <= start) {
+		return;
+	}
+	const uint count = end - start;
+	const uint chunks = JOBS.size() > 1 ? min(count, JOBS.size() * 4U) : 1U;
+	if (chunks <= 1) {
+		for (uint i = start; i < end; i++) {
+			body(i);
+		}
+		return;
+	}
+	const uint chunk_size = (count + chunks - 1) / chunks;
+	Task_Group group;
+	for (uint chunk_start = start; chunk_start < end; chunk_start += chunk_size) {
+		const uint chunk_end = min(end, chunk_start + chunk_size);
+		group.run([&body, chunk_start, chunk_end]() {
+			for (uint i = chunk_start; i < chunk_end; i++) {
+				body(i);
+			}
+		});
+	}
+	group.wait();
+}
+
+// Runs job on the pool, the future holds its result. Waiting on it from inside a job blocks that worker.
+template <typename F>
+auto f_async(F job) -> future<decltype(job())> {
+	using Result = decltype(job());
+	shared_ptr<packaged_task<Result()>> task = make_shared<packaged_task<Result()>>(std::move(job));
+	future<Result> result = task->get_future();
+	JOBS.submit([task]() { (*task)(); });
+	return result;
+}
@@ -180,6 +180,88 @@ Confirm<GLuint> computeShaderProgram(const string& file_path) {
 	return Confirm(shader_program);
 }
 
+Ssbo_Ring::Ssbo_Ring() {
+	buffer = 0;
+	capacity = 0;
+	size = 0;
+	region = 0;
+	mapped = nullptr;
+	for (uint i = 0; i < SSBO_RING_REGIONS; i++) {
+		fences[i] = nullptr;
+	}
+}
+
+void Ssbo_Ring::write(const void* data, const GLsizeiptr& size) {
+	reserve(size);
+	region = (region + 1) % SSBO_RING_REGIONS;
+	waitRegion(region);
+	if (size > 0) {
+		memcpy(mapped + region * capacity, data, size);
+	}
+	this->size = size;
+}
+
+void Ssbo_Ring::bind(const GLuint& binding) const {
+	if (size > 0) {
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, region * capacity, size);
+	}
+	else {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+}
+
+// Called after the dispatch reading the current region, a region that is not rewritten keeps being fenced by every draw
+void Ssbo_Ring::fence() {
+	if (buffer == 0) {
+		return;
+	}
+	if (fences[region]) {
+		glDeleteSync(fences[region]);
+	}
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void Ssbo_Ring::release() {
+	for (uint i = 0; i < SSBO_RING_REGIONS; i++) {
+		waitRegion(i);
+	}
+	if (buffer != 0) {
+		glUnmapNamedBuffer(buffer);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	capacity = 0;
+	size = 0;
+	mapped = nullptr;
+}
+
+// Grows by half again so a slowly growing array does not reallocate every write
+void Ssbo_Ring::reserve(const GLsizeiptr& size) {
+	if (size <= capacity) {
+		return;
+	}
+	GLint alignment;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	GLsizeiptr new_capacity = max(size, capacity + capacity / 2);
+	new_capacity = (new_capacity + alignment - 1) / alignment * alignment;
+	release();
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &buffer);
+	glNamedBufferStorage(buffer, new_capacity * SSBO_RING_REGIONS, nullptr, flags);
+	mapped = static_cast<char*>(glMapNamedBufferRange(buffer, 0, new_capacity * SSBO_RING_REGIONS, flags));
+	capacity = new_capacity;
+}
+
+void Ssbo_Ring::waitRegion(const uint& index) {
+	if (!fences[index]) {
+		return;
+	}
+	while (glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+	glDeleteSync(fences[index]);
+	fences[index] = nullptr;
+}
+
 GLuint renderLayer(const uvec2& resolution) {
 	GLuint ID;
 	glCreateTextures(GL_TEXTURE_2D, 1, &ID);
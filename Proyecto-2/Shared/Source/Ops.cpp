@@ -234,40 +234,64 @@ string preprocessShader(const string& file_path) {
 }
 
 dvec1 randD() {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
 	uniform_real_distribution<dvec1> dis(0.0, 1.0);
 	return dis(gen);
 }
 
 vec1 randF() {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
 	uniform_real_distribution<vec1> dis(0.0f, 1.0f);
 	return dis(gen);
 }
 
 dvec1 randD(const dvec1& min, const dvec1& max) {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
 	uniform_real_distribution<dvec1> dis(min, max);
 	return dis(gen);
 }
 
 vec1 randF(const vec1& min, const vec1& max) {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
 	uniform_real_distribution<vec1> dis(min, max);
 	return dis(gen);
 }
 
 vec1 randF(const dvec1& min, const dvec1& max) {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
 	uniform_real_distribution<vec1> dis(d_to_f(min), d_to_f(max));
 	return dis(gen);
 }
 
+uint64 f_squares64(const uint64& counter, const uint64& key) {
+	uint64 x = counter * key;
+	const uint64 y = x;
+	const uint64 z = y + key;
+	x = x * x + y; x = (x >> 32) | (x << 32);
+	x = x * x + z; x = (x >> 32) | (x << 32);
+	x = x * x + y; x = (x >> 32) | (x << 32);
+	const uint64 t = x = x * x + z; x = (x >> 32) | (x << 32);
+	return t ^ ((x * x + y) >> 32);
+}
+
+uint64 f_rngKey(const uint64& seed, const uint64& step) {
+	// SplitMix64 finalizer, spreads bits over the whole key, which Squares needs, and keeps it odd
+	uint64 key = seed + (step + 1) * 0x9E3779B97F4A7C15ULL;
+	key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+	return (key ^ (key >> 31)) | 1ULL;
+}
+
+dvec1 f_randD(const uint64& seed, const uint& entity, const uint64& step, const uint& draw) {
+	const uint64 counter = (u_to_ul(entity) << 32) | u_to_ul(draw);
+	return ul_to_d(f_squares64(counter, f_rngKey(seed, step)) >> 11) / 9007199254740992.0; // [0, 1), top 53 bits
+}
+
 bool insideAABB(const vec3& point, vec3& p_min, const vec3& p_max) {
 	return (point.x >= p_min.x && point.x <= p_max.x) &&
 		(point.y >= p_min.y && point.y <= p_max.y) &&
@@ -0,0 +1,152 @@
+#include "Threading.hpp"
+
+// Index of the pool worker running on this thread, MAX_UINT32 outside the pool
+static thread_local uint worker_index = MAX_UINT32;
+
+Job_System::Job_System() :
+	queued(0U),
+	next_queue(0U),
+	stopping(false),
+	thread_count(0U)
+{
+	resize(max(1U, thread::hardware_concurrency()));
+}
+
+Job_System::~Job_System() {
+	stop();
+}
+
+Job_System& Job_System::getInstance() {
+	static Job_System instance;
+	return instance;
+}
+
+void Job_System::resize(const uint& thread_count) {
+	const uint count = max(1U, thread_count);
+	if (count == this->thread_count) {
+		return;
+	}
+	stop();
+	this->thread_count = count;
+
+	// The thread waiting on a loop works too, but one worker is always kept so a future resolves without a waiter.
+	// At a size of 1 that worker only runs futures, loops and groups stay on the caller.
+	const uint worker_count = max(1U, count - 1U);
+	queues.clear();
+	for (uint i = 0; i < worker_count; i++) {
+		queues.push_back(make_unique<Job_Queue>());
+	}
+	stopping.store(false);
+	for (uint i = 0; i < worker_count; i++) {
+		workers.emplace_back(&Job_System::work, this, i);
+	}
+}
+
+uint Job_System::size() const {
+	return thread_count;
+}
+
+void Job_System::submit(function<void()> job) {
+	const uint worker = worker_index < len32(queues) ? worker_index : next_queue.fetch_add(1U, memory_order_relaxed) % len32(queues);
+	{
+		const lock_guard<mutex> lock(queues[worker]->lock);
+		queues[worker]->jobs.push_back(std::move(job));
+	}
+	queued.fetch_add(1U, memory_order_release);
+	{
+		// Taken so a worker between its queue check and its wait cannot miss the notification
+		const lock_guard<mutex> lock(sleep_mutex);
+	}
+	wake.notify_one();
+}
+
+bool Job_System::pop(const uint& worker, function<void()>& job) {
+	const uint queue_count = len32(queues);
+	if (worker < queue_count) {
+		Job_Queue& own = *queues[worker];
+		const lock_guard<mutex> lock(own.lock);
+		if (!own.jobs.empty()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	const uint first = worker < queue_count ? worker + 1 : next_queue.load(memory_order_relaxed);
+	for (uint i = 0; i < queue_count; i++) {
+		Job_Queue& victim = *queues[(first + i) % queue_count];
+		const lock_guard<mutex> lock(victim.lock);
+		if (!victim.jobs.empty()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Job_System::runOne() {
+	if (queued.load(memory_order_acquire) == 0) {
+		return false;
+	}
+	function<void()> job;
+	if (!pop(worker_index, job)) {
+		return false;
+	}
+	queued.fetch_sub(1U, memory_order_relaxed);
+	job();
+	return true;
+}
+
+void Job_System::work(const uint& worker) {
+	worker_index = worker;
+	while (true) {
+		if (runOne()) {
+			continue;
+		}
+		unique_lock<mutex> lock(sleep_mutex);
+		wake.wait(lock, [this]() { return stopping.load() or queued.load() > 0; });
+		if (stopping.load() and queued.load() == 0) {
+			return;
+		}
+	}
+}
+
+void Job_System::stop() {
+	{
+		const lock_guard<mutex> lock(sleep_mutex);
+		stopping.store(true);
+	}
+	wake.notify_all();
+	for (thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
+
+Task_Group::Task_Group() :
+	pending(0U)
+{}
+
+Task_Group::~Task_Group() {
+	wait();
+}
+
+void Task_Group::run(function<void()> job) {
+	if (JOBS.size() <= 1) {
+		job();
+		return;
+	}
+	pending.fetch_add(1U, memory_order_relaxed);
+	JOBS.submit([this, job = std::move(job)]() {
+		job();
+		pending.fetch_sub(1U, memory_order_release);
+	});
+}
+
+void Task_Group::wait() {
+	while (pending.load(memory_order_acquire) > 0) {
+		if (!JOBS.runOne()) {
+			this_thread::yield();
+		}
+	}
+}